@@ -88,6 +88,10 @@ size_t xmlite_xmlnode_numValues(const xmlite_xmlnode_t * obj);
 bool xmlite_xmlnode_addValue(xmlite_xmlnode_t * obj, const char * val, size_t valLen);
 bool xmlite_xmlnode_add(xmlite_xmlnode_t * obj, const char * key, size_t keyLen, const char * val, size_t valLen);
 bool xmlite_xmlnode_addNode(xmlite_xmlnode_t * obj, const xmlite_xmlnode_t * other);
+// Moves other's contents into obj without copying, other is left empty but still has to be freed
+bool xmlite_xmlnode_addNodeMove(xmlite_xmlnode_t * obj, xmlite_xmlnode_t * other);
+// Removes a child and returns it as a new object without copying, has to be freed
+xmlite_xmlnode_t xmlite_xmlnode_extract(xmlite_xmlnode_t * obj, size_t idx);
 bool xmlite_xmlnode_remove(xmlite_xmlnode_t * obj, size_t idx);
 
 
@@ -106,6 +110,8 @@ extern const char * const * xmlite_xml_s_BOMStrings;
 
 xmlite_xml_t xmlite_xml_make(const char * xmlFile, size_t length);
 xmlite_xml_t xmlite_xml_makeNullTerm(const char * xmlFile);
+// Parses the file straight from a memory mapping
+xmlite_xml_t xmlite_xml_fromFile(const char * path);
 
 xmlite_xml_t xmlite_xml_copy(const xmlite_xml_t * obj);
 
@@ -1,4 +1,5 @@
 #include "../include/xmlite.h"
+#define XMLITE_FILE_MAPPING
 #include "../../include/xmlite.hpp"
 
 #include <string>
@@ -373,6 +374,31 @@ bool xmlite_xmlnode_addNode(xmlite_xmlnode_t * obj, const xmlite_xmlnode_t * oth
 		return false;
 	}
 }
+bool xmlite_xmlnode_addNodeMove(xmlite_xmlnode_t * obj, xmlite_xmlnode_t * other)
+{
+	try
+	{
+		static_cast<xmlite::xmlnode *>(obj->mem)->add(std::move(*static_cast<xmlite::xmlnode *>(other->mem)));
+		return true;
+	}
+	catch (std::exception & e)
+	{
+		inner::s_lastException = std::move(e);
+		return false;
+	}
+}
+xmlite_xmlnode_t xmlite_xmlnode_extract(xmlite_xmlnode_t * obj, size_t idx)
+{
+	try
+	{
+		return { new xmlite::xmlnode(static_cast<xmlite::xmlnode *>(obj->mem)->extract(idx)) };
+	}
+	catch (std::exception & e)
+	{
+		inner::s_lastException = std::move(e);
+		return { nullptr };
+	}
+}
 bool xmlite_xmlnode_remove(xmlite_xmlnode_t * obj, size_t idx)
 {
 	return static_cast<xmlite::xmlnode *>(obj->mem)->remove(idx);
@@ -410,6 +436,18 @@ xmlite_xml_t xmlite_xml_makeNullTerm(const char * xmlFile)
 		return { nullptr };
 	}
 }
+xmlite_xml_t xmlite_xml_fromFile(const char * path)
+{
+	try
+	{
+		return { new xmlite::xml(xmlite::xml::fromFile(path)) };
+	}
+	catch (std::exception & e)
+	{
+		inner::s_lastException = std::move(e);
+		return { nullptr };
+	}
+}
 
 xmlite_xml_t xmlite_xml_copy(const xmlite_xml_t * obj)
 {
@@ -4,11 +4,67 @@
 #include <string>
 #include <unordered_map>
 #include <stack>
+#include <memory>
+#include <iosfwd>
 #include <type_traits>
 #include <exception>
+#include <functional>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
 
 #include <cstring>
 #include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cerrno>
+
+#if defined(_WIN32)
+	#include <io.h>
+#else
+	#include <unistd.h>
+#endif
+
+// Define XMLITE_FILE_MAPPING to have xml::fromFile map files instead of reading them, it pulls in the platform headers
+#if defined(XMLITE_FILE_MAPPING)
+	#if defined(_WIN32)
+		#if !defined(WIN32_LEAN_AND_MEAN)
+			#define WIN32_LEAN_AND_MEAN
+			#define XMLITE_UNDEF_LEAN_AND_MEAN
+		#endif
+		#if !defined(NOMINMAX)
+			#define NOMINMAX
+			#define XMLITE_UNDEF_NOMINMAX
+		#endif
+		#include <windows.h>
+		#if defined(XMLITE_UNDEF_LEAN_AND_MEAN)
+			#undef WIN32_LEAN_AND_MEAN
+			#undef XMLITE_UNDEF_LEAN_AND_MEAN
+		#endif
+		#if defined(XMLITE_UNDEF_NOMINMAX)
+			#undef NOMINMAX
+			#undef XMLITE_UNDEF_NOMINMAX
+		#endif
+	#else
+		#include <fcntl.h>
+		#include <sys/mman.h>
+		#include <sys/stat.h>
+	#endif
+#endif
+
+// Define XMLITE_NO_SIMD to only use the portable scanning loops
+#if !defined(XMLITE_NO_SIMD) && (defined(__x86_64__) || defined(_M_X64))
+	#define XMLITE_X86_SIMD
+	#include <immintrin.h>
+	#if defined(_MSC_VER) && !defined(__clang__)
+		#include <intrin.h>
+		#define XMLITE_TARGET(isa)
+	#else
+		#define XMLITE_TARGET(isa) __attribute__((target(isa)))
+	#endif
+#endif
 
 namespace xmlite
 {
@@ -37,6 +93,9 @@ namespace xmlite
 	inline std::string UTF7toUTF8(const char * utfStr, std::size_t length);
 	inline std::string UTF1toUTF8(const char * utfStr, std::size_t length);
 
+	// Offset of the first ill-formed UTF-8 sequence, length if the whole string is valid
+	inline std::size_t validateUTF8(const char * str, std::size_t length) noexcept;
+
 	template<typename T, typename U = typename std::underlying_type<T>::type>
 	constexpr U underlying_cast(T enumClass) noexcept
 	{
@@ -44,1234 +103,5716 @@ namespace xmlite
 	}
 
 	class xmlnode;
+	class xmldoc;
 	class xml;
+	class writer;
 
-	class exception : public std::exception
+	enum class parseEngine : std::uint8_t
 	{
-	private:
-		friend class xmlnode;
-		friend class xml;
-		
-		enum class Type : std::uint_fast8_t
-		{
-			Unknown,
-			NotAnEndpoint,
-			OutOfBounds,
-
-			ParseIncorrectHeader,
-			ParseIncorrectHeaderTerminator,
-			ParseIncorrectTag,
-			ParseIncorrectComment,
-			ParseIncorrectEscapeCharacter,
-			ParseNoTerminatingTag,
-			ParseNoTerminatingQuote,
-			ParseTooManyRoots,
-			ParseNoRoot,
-			ParseComment2Dashes,
-
-			enum_size
-		};
+		// Single pass over the input, uses an explicit stack instead of recursion
+		Linear,
+		// The original engine, recurses for every child element
+		Recursive,
 
-		Type m_type;
-		std::string m_optMsg;
-		static constexpr const char * exceptionMessages[underlying_cast(Type::enum_size)]
-		{
-			"Unknown exception.",
-			"This is not an end-point in the object structure!",
-			"The array does not contain an item at this index!",
+		enum_size
+	};
 
-			"Incorrect XML header!",
-			"Incorrect XML header terminator!",
-			"Incorrect tag!",
-			"Incorrect comment format!",
-			"Incorrect escape character!",
-			"No tag terminator found!",
-			"No terminating '\"' found!",
-			"Too many root elements!",
-			"No root element found!",
-			"2 dashes found in the middle of comment!"
-		};
-	public:
-		explicit exception(Type type = Type::Unknown) noexcept
-			: m_type(type)
-		{
-		}
-		explicit exception(Type type, const char * extra, std::size_t extraLen)
-			: m_type(type), m_optMsg(this->exceptionMessages[underlying_cast(type)] +
-				std::string(" At: \"") + std::string{ extra, strlen(extra, extraLen) } + '\"')
-		{
-		}
+	enum class docStorage : std::uint8_t
+	{
+		// Every xmlnode owns its strings & containers
+		Nodes,
+		// Nodes and strings are stored in a few large blocks owned by the xmldoc
+		Arena,
+		/*
+		 * Like Arena, but tags, attributes and text are views into the input buffer,
+		 * which has to outlive the document unless it had to be converted from a BOM encoding
+		 */
+		View,
+
+		enum_size
+	};
 
-		virtual const char * what() const throw() override
-		{
-			if (this->m_optMsg.empty())
-			{
-				return this->exceptionMessages[underlying_cast(this->m_type)];
-			}
-			else
-			{
-				return this->m_optMsg.c_str();
-			}
-		}
+	enum class dumpStyle : std::uint8_t
+	{
+		// Every tag & text on a line of its own, indented with tabs
+		Pretty,
+		// No whitespace is added at all
+		Minified,
 
+		enum_size
 	};
 
-	constexpr const char * exception::exceptionMessages[];
-
-	class xmlnode
+	struct dumpOptions
 	{
-	public:
-		using String = std::string;
-		template<typename T, typename U>
-		using HashMap = std::unordered_map<T, U>;
-		template<typename T>
-		using Vec = std::vector<T>;
-
-		using IdxVec = Vec<std::size_t>;
+		dumpStyle style{ dumpStyle::Pretty };
+		// Measures the output first, so the buffer is allocated only once
+		bool exactSize{ false };
+	};
 
-		using AttrMap = HashMap<String, String>;
-		using ValueVec = Vec<xmlnode>;
-		using IdxMap = HashMap<String, IdxVec>;
+	struct parseOptions
+	{
+		parseEngine engine{ parseEngine::Linear };
+		// Skips all well-formedness checks, only for input that is known to be correct
+		bool trusted{ false };
+		// Used by xml, xmlnode always owns its own storage
+		docStorage storage{ docStorage::Nodes };
+		/*
+		 * Rejects input that isn't well-formed UTF-8, the exception tells the offset of the bad sequence.
+		 * Only input without a BOM or with the UTF-8 one is checked, other encodings are converted anyway
+		 */
+		bool validateUTF8{ false };
+		/*
+		 * Resolves entity & character references in character data and attribute values while parsing,
+		 * otherwise they are stored as written and can be resolved on demand with decodeEntities
+		 */
+		bool decodeEntities{ false };
+		/*
+		 * Threads building the tree of a large document with the single-pass parser, 0 means one per core.
+		 * Checking the document & finding where it can be split is still one sequential pass
+		 */
+		std::size_t threads{ 1 };
+	};
 
+	// Non-owning reference to a character sequence
+	class strview
+	{
 	private:
-		String m_tag;
-		AttrMap m_attributes;
-
-		ValueVec m_values;
-		IdxMap m_idxMap;
-
-		enum class objtype : std::uint8_t
-		{
-			EmptyObject,
-			Object,
-			EndPoint
-		};
-		objtype m_role{ objtype::EmptyObject };
+		const char * m_str{ nullptr };
+		std::size_t m_len{ 0 };
 
-		static inline xmlnode innerParse(const char * xml, std::size_t len);
-		inline std::string innerDump(std::size_t depth) const;
-		
-		void buildIdxMap() noexcept
+	public:
+		constexpr strview() noexcept = default;
+		constexpr strview(const char * str, std::size_t len) noexcept
+			: m_str(str), m_len(len)
 		{
-			try
-			{
-				for (auto & i : this->m_idxMap)
-				{
-					if (!i.second.empty())
-					{
-						i.second.clear();
-					}
-				}
-				for (std::size_t i = 0, sz = this->m_values.size(); i < sz; ++i)
-				{
-					this->m_idxMap.at(this->m_values[i].m_tag).push_back(i);
-				}
-			}
-			catch (const std::exception &)
-			{
-				// Do nothing
-			}
 		}
-
-	public:
-
-		xmlnode() noexcept = default;
-		xmlnode(const xmlnode & other) = default;
-		xmlnode(xmlnode && other) noexcept = default;
-		xmlnode & operator=(const xmlnode & other) = default;
-		xmlnode & operator=(xmlnode && other) noexcept = default;
-		~xmlnode() noexcept = default;
-
-		inline xmlnode(const char * xmlFile, std::size_t length);
-		xmlnode(const char * xmlFile)
-			: xmlnode(xmlFile, std::char_traits<char>::length(xmlFile))
+		strview(const char * str) noexcept
+			: m_str(str), m_len(std::char_traits<char>::length(str))
 		{
 		}
-		xmlnode(const std::string & xmlFile)
-			: xmlnode(xmlFile.c_str(), xmlFile.length())
+		strview(const std::string & str) noexcept
+			: m_str(str.c_str()), m_len(str.length())
 		{
 		}
 
-		std::string dump() const
+		constexpr const char * data() const noexcept
 		{
-			return this->innerDump(0);
+			return this->m_str;
 		}
-
-		String & tag() noexcept
+		constexpr std::size_t size() const noexcept
 		{
-			return this->m_tag;
+			return this->m_len;
 		}
-		const String & tag() const noexcept
+		constexpr std::size_t length() const noexcept
 		{
-			return this->m_tag;
+			return this->m_len;
 		}
-		explicit operator String & () noexcept
+		constexpr bool empty() const noexcept
 		{
-			return this->m_tag;
+			return this->m_len == 0;
 		}
-		explicit operator const String & () const noexcept
+		constexpr const char * begin() const noexcept
 		{
-			return this->m_tag;
+			return this->m_str;
 		}
-
-		AttrMap & attr() noexcept
+		constexpr const char * end() const noexcept
 		{
-			return this->m_attributes;
+			return this->m_str + this->m_len;
 		}
-		const AttrMap & attr() const noexcept
+		constexpr char operator[](std::size_t idx) const noexcept
 		{
-			return this->m_attributes;
+			return this->m_str[idx];
 		}
-		explicit operator AttrMap & () noexcept
+
+		std::string str() const
 		{
-			return this->m_attributes;
+			return { this->m_str, this->m_len };
 		}
-		explicit operator const AttrMap & () const noexcept
+		explicit operator std::string() const
 		{
-			return this->m_attributes;
+			return this->str();
 		}
 
-		bool exists(const std::string & str) const noexcept
+		friend bool operator==(strview lhs, strview rhs) noexcept
 		{
-			return this->m_idxMap.find(str) != this->m_idxMap.end();
+			return lhs.m_len == rhs.m_len && (lhs.m_len == 0 || std::memcmp(lhs.m_str, rhs.m_str, lhs.m_len) == 0);
 		}
-		const IdxVec & at(const std::string & str) const
+		friend bool operator!=(strview lhs, strview rhs) noexcept
 		{
-			return this->m_idxMap.at(str);
+			return !(lhs == rhs);
 		}
-		const xmlnode & at(std::size_t idx) const
+	};
+
+	template<typename Traits>
+	std::basic_ostream<char, Traits> & operator<<(std::basic_ostream<char, Traits> & os, strview str)
+	{
+		return os.write(str.data(), std::streamsize(str.size()));
+	}
+
+	// Attribute as it's written in the start tag, both parts refer to the parsed buffer
+	struct attrview
+	{
+		strview name, value;
+	};
+
+	/*
+	 * Base for handlers of the streaming parser, events are ignored unless the derived handler
+	 * has a member of the same name. The views are only valid during the call
+	 */
+	struct saxhandler
+	{
+		void startElement(strview, const attrview *, std::size_t)
 		{
-			return this->m_values.at(idx);
 		}
-		const IdxVec & operator[](const std::string & str)
+		void endElement(strview)
 		{
-			auto & item = this->m_idxMap[str];
-			if (item.empty())
-			{
-				this->add(str);
-			}
-			return this->m_idxMap.at(str);
 		}
-		xmlnode & operator[](std::size_t idx) noexcept
+		void text(strview)
 		{
-			return this->m_values[idx];
 		}
-		const xmlnode & operator[](std::size_t idx) const noexcept
+		void comment(strview)
 		{
-			return this->m_values[idx];
 		}
+	};
 
-		std::size_t numValues() const noexcept
+	/*
+	 * Streams a document through the handler without building a tree, events refer to the input
+	 * (or to the converted copy of BOM-marked input). With decodeEntities only values with references
+	 * are decoded, into a buffer that's reused between events. Character data is reported in runs
+	 * as it's written, whitespace isn't collapsed; CDATA sections come as text that's never decoded.
+	 * Text outside the root element isn't reported
+	 */
+	template<typename Handler>
+	inline void parse(const char * xmlFile, std::size_t length, Handler & handler, const parseOptions & options = parseOptions());
+	template<typename Handler>
+	void parse(const std::string & xmlFile, Handler & handler, const parseOptions & options = parseOptions())
+	{
+		parse(xmlFile.c_str(), xmlFile.length(), handler, options);
+	}
+
+	/*
+	 * Only checks that the document is well-formed, throws the same exceptions as the single-pass parser.
+	 * With more than one thread a large document is split into chunks that are checked concurrently
+	 */
+	inline void check(const char * xmlFile, std::size_t length, const parseOptions & options = parseOptions());
+	inline void check(const std::string & xmlFile, const parseOptions & options = parseOptions())
+	{
+		check(xmlFile.c_str(), xmlFile.length(), options);
+	}
+
+	/*
+	 * Resolves entity & character references (decimal & hexadecimal). Values without any
+	 * are returned as they are, otherwise the result is decoded into buf and refers to it
+	 */
+	inline strview decodeEntities(strview value, std::string & buf);
+
+	/*
+	 * Monotonic allocator, memory is handed out from a few large blocks by bumping a pointer
+	 * and is only given back all at once. Only suitable for trivially destructible objects
+	 */
+	class arena
+	{
+	private:
+		struct block
 		{
-			return this->m_values.size();
-		}
+			std::unique_ptr<char[]> mem;
+			std::size_t size;
+		};
+		std::vector<block> m_blocks;
+		char * m_cur{ nullptr };
+		std::size_t m_left{ 0 };
+		std::size_t m_blockSize;
 
-		void add(const std::string & value)
+	public:
+		static constexpr std::size_t defBlockSize{ 64 * 1024 };
+		static constexpr std::size_t maxBlockSize{ 16 * 1024 * 1024 };
+
+		explicit arena(std::size_t blockSize = defBlockSize) noexcept
+			: m_blockSize(blockSize)
 		{
-			auto idx = this->m_values.size();
-			this->m_values.emplace_back();
-			auto & obj = this->m_values.back();
-			obj.m_tag = value;
-			obj.m_role = objtype::EndPoint;
-			this->m_role = objtype::Object;
-			this->m_idxMap[value].push_back(idx);
 		}
-		void add(const std::string & key, const std::string & value)
+		arena(const arena & other) = delete;
+		arena(arena && other) noexcept
+			: m_blocks(std::move(other.m_blocks)), m_cur(other.m_cur), m_left(other.m_left), m_blockSize(other.m_blockSize)
 		{
-			auto idx = this->m_values.size();
-			this->m_values.emplace_back();
-			this->m_values.back().m_tag = key;
-			this->m_values.back().add(value);
-			this->m_idxMap[key].push_back(idx);
+			other.m_cur  = nullptr;
+			other.m_left = 0;
 		}
-		void add(const xmlnode & other)
+		arena & operator=(const arena & other) = delete;
+		arena & operator=(arena && other) noexcept
 		{
-			auto idx = this->m_values.size();
-			this->m_values.emplace_back(other);
-			this->m_idxMap[other.m_tag].push_back(idx);
-			this->m_role = objtype::Object;
+			this->m_blocks    = std::move(other.m_blocks);
+			this->m_cur       = other.m_cur;
+			this->m_left      = other.m_left;
+			this->m_blockSize = other.m_blockSize;
+			other.m_cur  = nullptr;
+			other.m_left = 0;
+			return *this;
 		}
-		bool remove(std::size_t idx) noexcept
+		~arena() noexcept = default;
+
+		inline void * allocate(std::size_t size, std::size_t align = alignof(std::max_align_t));
+		template<typename T>
+		T * make(std::size_t num = 1)
 		{
-			try
+			static_assert(std::is_trivially_destructible<T>::value, "Arena objects are never destroyed!");
+			auto mem = static_cast<T *>(this->allocate(num * sizeof(T), alignof(T)));
+			for (std::size_t i = 0; i < num; ++i)
 			{
-				this->m_idxMap.at(this->m_values[idx].m_tag).pop_back();
-				this->m_values.erase(this->m_values.begin() + idx);
-				this->buildIdxMap();
-				return true;
+				new (mem + i) T();
 			}
-			catch (const std::exception & e)
+			return mem;
+		}
+		strview store(const char * str, std::size_t len)
+		{
+			if (len == 0)
 			{
-				return false;
+				return {};
 			}
+			auto mem = static_cast<char *>(this->allocate(len, 1));
+			std::memcpy(mem, str, len);
+			return { mem, len };
 		}
 
+		// Gives back all memory at once, the newest block is kept for reuse
+		void reset() noexcept
+		{
+			if (this->m_blocks.size() > 1)
+			{
+				this->m_blocks.erase(this->m_blocks.begin(), this->m_blocks.end() - 1);
+			}
+			this->m_cur  = this->m_blocks.empty() ? nullptr : this->m_blocks.back().mem.get();
+			this->m_left = this->m_blocks.empty() ? 0 : this->m_blocks.back().size;
+		}
+		std::size_t numBlocks() const noexcept
+		{
+			return this->m_blocks.size();
+		}
+		// Whether the memory was handed out by this arena
+		bool owns(const void * ptr) const noexcept
+		{
+			auto p = static_cast<const char *>(ptr);
+			for (const auto & b : this->m_blocks)
+			{
+				if (std::less_equal<const char *>()(b.mem.get(), p) && std::less<const char *>()(p, b.mem.get() + b.size))
+				{
+					return true;
+				}
+			}
+			return false;
+		}
 	};
 
-	class xml
+	constexpr std::size_t arena::defBlockSize;
+	constexpr std::size_t arena::maxBlockSize;
+
+	namespace inner
 	{
-	public:
-		enum class version : std::uint8_t
+		inline bool isWhiteSpace(char ch) noexcept
 		{
-			v1_0,
-			v1_1,
+			return ch == ' ' || ch == '\n' || ch == '\t' || ch == '\r';
+		}
 
-			enum_size
-		};
-		static constexpr const char * versionStr[underlying_cast(version::enum_size)]
+		/*
+		 * Byte scanning kernels used by the parsers' hot loops. On x86-64 SSE2 is always there,
+		 * AVX2 & AVX-512 versions are picked at runtime, the remainder is handled by plain loops
+		 */
+		namespace simd
 		{
-			"1.0",
-			"1.1"
-		};
+			enum class level : std::uint8_t
+			{
+				None,
+				SSE2,
+				AVX2,
+				AVX512
+			};
 
-		enum class BOMencoding : std::uint8_t
-		{
-			UTF_32LE,
-			UTF_32BE,
-			UTF_8,
-			UTF_7,
-			UTF_1,
-			UTF_16LE,
-			UTF_16BE,
+			inline level detect() noexcept
+			{
+#if defined(XMLITE_X86_SIMD)
+	#if defined(_MSC_VER) && !defined(__clang__)
+				int info[4];
+				__cpuid(info, 0);
+				if (info[0] < 7)
+				{
+					return level::SSE2;
+				}
+				__cpuid(info, 1);
+				// OS has to save the wider registers as well
+				if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0)
+				{
+					return level::SSE2;
+				}
+				const auto xcr0 = _xgetbv(0);
+				__cpuidex(info, 7, 0);
+				if ((xcr0 & 0xE6) == 0xE6 && (info[1] & (1 << 16)) != 0 && (info[1] & (1 << 30)) != 0)
+				{
+					return level::AVX512;
+				}
+				else if ((xcr0 & 0x06) == 0x06 && (info[1] & (1 << 5)) != 0)
+				{
+					return level::AVX2;
+				}
+				return level::SSE2;
+	#else
+				__builtin_cpu_init();
+				if (__builtin_cpu_supports("avx512bw"))
+				{
+					return level::AVX512;
+				}
+				else if (__builtin_cpu_supports("avx2"))
+				{
+					return level::AVX2;
+				}
+				return level::SSE2;
+	#endif
+#else
+				return level::None;
+#endif
+			}
+			inline level cpuLevel() noexcept
+			{
+				static const level lvl = detect();
+				return lvl;
+			}
 
-			enum_size
-		};
-		static constexpr const std::uint8_t BOMLength[]
-		{
-			4,
-			4,
-			3,
-			3,
-			3,
-			2,
-			2
-		};
-		static constexpr const char * BOMStrings[]
-		{
-			"UTF-32LE",
-			"UTF-32BE",
-			"UTF-8",
-			"UTF-7",
-			"UTF-1",
-			"UTF-16LE",
-			"UTF-16BE"
-		};
-	
-	private:
-		friend class xmlnode;
+#if defined(XMLITE_X86_SIMD)
+			inline unsigned ctz(std::uint64_t mask) noexcept
+			{
+	#if defined(_MSC_VER) && !defined(__clang__)
+				unsigned long idx;
+				_BitScanForward64(&idx, mask);
+				return unsigned(idx);
+	#else
+				return unsigned(__builtin_ctzll(mask));
+	#endif
+			}
 
-		static constexpr const char * defEnc{ "UTF-8" };
+			/*
+			 * Kernels stop at the first byte equal to any of a, b, c, d (or none of them if Invert),
+			 * otherwise at the start of the remainder that's too short for a whole vector
+			 */
+			template<bool Invert>
+			inline const char * scanSSE2(const char * it, const char * end, char a, char b, char c, char d) noexcept
+			{
+				const __m128i va = _mm_set1_epi8(a), vb = _mm_set1_epi8(b), vc = _mm_set1_epi8(c), vd = _mm_set1_epi8(d);
+				for (; end - it >= 16; it += 16)
+				{
+					const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(it));
+					const __m128i eq = _mm_or_si128(
+						_mm_or_si128(_mm_cmpeq_epi8(v, va), _mm_cmpeq_epi8(v, vb)),
+						_mm_or_si128(_mm_cmpeq_epi8(v, vc), _mm_cmpeq_epi8(v, vd))
+					);
+					std::uint32_t mask = std::uint32_t(_mm_movemask_epi8(eq));
+					if (Invert)
+					{
+						mask ^= 0xFFFF;
+					}
+					if (mask != 0)
+					{
+						return it + ctz(mask);
+					}
+				}
+				return it;
+			}
+			template<bool Invert>
+			XMLITE_TARGET("avx2") inline const char * scanAVX2(const char * it, const char * end, char a, char b, char c, char d) noexcept
+			{
+				const __m256i va = _mm256_set1_epi8(a), vb = _mm256_set1_epi8(b), vc = _mm256_set1_epi8(c), vd = _mm256_set1_epi8(d);
+				for (; end - it >= 32; it += 32)
+				{
+					const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(it));
+					const __m256i eq = _mm256_or_si256(
+						_mm256_or_si256(_mm256_cmpeq_epi8(v, va), _mm256_cmpeq_epi8(v, vb)),
+						_mm256_or_si256(_mm256_cmpeq_epi8(v, vc), _mm256_cmpeq_epi8(v, vd))
+					);
+					std::uint32_t mask = std::uint32_t(_mm256_movemask_epi8(eq));
+					if (Invert)
+					{
+						mask = ~mask;
+					}
+					if (mask != 0)
+					{
+						return it + ctz(mask);
+					}
+				}
+				return scanSSE2<Invert>(it, end, a, b, c, d);
+			}
+			// Masked loads cover the remainder as well
+			template<bool Invert>
+			XMLITE_TARGET("avx512f,avx512bw") inline const char * scanAVX512(const char * it, const char * end, char a, char b, char c, char d) noexcept
+			{
+				const __m512i va = _mm512_set1_epi8(a), vb = _mm512_set1_epi8(b), vc = _mm512_set1_epi8(c), vd = _mm512_set1_epi8(d);
+				while (it != end)
+				{
+					const std::size_t len = std::size_t(end - it);
+					const __mmask64 load = len >= 64 ? ~__mmask64(0) : (__mmask64(1) << len) - 1;
+					const __m512i v = _mm512_maskz_loadu_epi8(load, it);
+					__mmask64 mask = _mm512_cmpeq_epi8_mask(v, va) | _mm512_cmpeq_epi8_mask(v, vb) |
+						_mm512_cmpeq_epi8_mask(v, vc) | _mm512_cmpeq_epi8_mask(v, vd);
+					if (Invert)
+					{
+						mask = ~mask;
+					}
+					mask &= load;
+					if (mask != 0)
+					{
+						return it + ctz(mask);
+					}
+					it += len >= 64 ? 64 : len;
+				}
+				return it;
+			}
 
-		version m_ver{ version::v1_0 };
-		std::string m_encoding{ defEnc };
-		bool m_standalone{};
-		bool m_verInit, m_encInit, m_saInit;
+			/*
+			 * Narrows the next 16 code units of Size bytes to bytes at out (16 bytes are always written),
+			 * returns how many of them were ASCII before the first one that isn't
+			 */
+			template<std::size_t Size, bool BigEndian>
+			inline std::size_t asciiPrefix(const char * it, char * out) noexcept
+			{
+				const __m128i zero = _mm_setzero_si128();
+				// Bits that have to be clear for ASCII, with the bytes as loaded on this little-endian target
+				const __m128i high = Size == 2 ?
+					_mm_set1_epi16(std::int16_t(BigEndian ? 0x80FF : 0xFF80)) :
+					_mm_set1_epi32(std::int32_t(BigEndian ? 0x80FFFFFFU : 0xFFFFFF80U));
+				constexpr int shift = BigEndian ? int(Size - 1) * 8 : 0;
+
+				__m128i v[Size];
+				std::uint64_t ascii = 0;
+				for (std::size_t i = 0; i < Size; ++i)
+				{
+					v[i] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(it + 16 * i));
+					const __m128i clear = Size == 2 ? _mm_cmpeq_epi16(_mm_and_si128(v[i], high), zero) : _mm_cmpeq_epi32(_mm_and_si128(v[i], high), zero);
+					ascii |= std::uint64_t(std::uint32_t(_mm_movemask_epi8(clear))) << (16 * i);
+					if (BigEndian)
+					{
+						v[i] = Size == 2 ? _mm_srli_epi16(v[i], shift) : _mm_srli_epi32(v[i], shift);
+					}
+				}
+				const __m128i bytes = Size == 2 ?
+					_mm_packus_epi16(v[0], v[1]) :
+					_mm_packus_epi16(_mm_packs_epi32(v[0], v[1 % Size]), _mm_packs_epi32(v[2 % Size], v[3 % Size]));
+				_mm_storeu_si128(reinterpret_cast<__m128i *>(out), bytes);
 
-		xmlnode m_nodes;
+				const std::uint64_t all = Size == 2 ? 0xFFFFFFFFU : ~std::uint64_t(0);
+				return ascii == all ? 16 : ctz(~ascii) / Size;
+			}
 
-		static inline void innerCheck(const char * xml, std::size_t len);
+			// Stops at the first 16 byte block that isn't pure ASCII, or at the remainder
+			inline const char * skipASCII(const char * it, const char * end) noexcept
+			{
+				for (; end - it >= 16; it += 16)
+				{
+					if (_mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(it))) != 0)
+					{
+						break;
+					}
+				}
+				return it;
+			}
 
-	public:
+			/*
+			 * UTF-8 validation by nibble lookups (Keiser & Lemire), every pair of adjacent bytes is
+			 * classified with three 16-entry tables, 3rd & 4th bytes of a sequence are checked by shifting.
+			 * Returns the start of the first 32 byte block with an error in it, otherwise the start of
+			 * the remainder; bytes just before the returned position may still begin an incomplete sequence
+			 */
+			XMLITE_TARGET("avx2") inline const char * utf8AVX2(const char * it, const char * end) noexcept
+			{
+				constexpr char tooShort = 1 << 0, tooLong = 1 << 1, overlong3 = 1 << 2, tooLarge = 1 << 3,
+					surrogate = 1 << 4, overlong2 = 1 << 5, tooLarge1000 = 1 << 6, overlong4 = 1 << 6;
+				constexpr char twoConts = char(1 << 7), carry = char(tooShort | tooLong | twoConts);
+
+				// Indexed by the high nibble of the first byte of a pair
+				const __m256i byte1High = _mm256_broadcastsi128_si256(_mm_setr_epi8(
+					tooLong, tooLong, tooLong, tooLong, tooLong, tooLong, tooLong, tooLong,
+					twoConts, twoConts, twoConts, twoConts,
+					tooShort | overlong2,
+					tooShort,
+					tooShort | overlong3 | surrogate,
+					tooShort | tooLarge | tooLarge1000 | overlong4
+				));
+				// Low nibble of the first byte
+				const __m256i byte1Low = _mm256_broadcastsi128_si256(_mm_setr_epi8(
+					char(carry | overlong3 | overlong2 | overlong4),
+					char(carry | overlong2),
+					carry,
+					carry,
+					char(carry | tooLarge),
+					char(carry | tooLarge | tooLarge1000),
+					char(carry | tooLarge | tooLarge1000),
+					char(carry | tooLarge | tooLarge1000),
+					char(carry | tooLarge | tooLarge1000),
+					char(carry | tooLarge | tooLarge1000),
+					char(carry | tooLarge | tooLarge1000),
+					char(carry | tooLarge | tooLarge1000),
+					char(carry | tooLarge | tooLarge1000),
+					char(carry | tooLarge | tooLarge1000 | surrogate),
+					char(carry | tooLarge | tooLarge1000),
+					char(carry | tooLarge | tooLarge1000)
+				));
+				// High nibble of the second byte
+				const __m256i byte2High = _mm256_broadcastsi128_si256(_mm_setr_epi8(
+					tooShort, tooShort, tooShort, tooShort, tooShort, tooShort, tooShort, tooShort,
+					char(tooLong | overlong2 | twoConts | overlong3 | tooLarge1000 | overlong4),
+					char(tooLong | overlong2 | twoConts | overlong3 | tooLarge),
+					char(tooLong | overlong2 | twoConts | surrogate | tooLarge),
+					char(tooLong | overlong2 | twoConts | surrogate | tooLarge),
+					tooShort, tooShort, tooShort, tooShort
+				));
+				const __m256i nibble = _mm256_set1_epi8(0x0F), high = _mm256_set1_epi8(char(0x80));
+				const __m256i third = _mm256_set1_epi8(char(0xE0 - 0x80)), fourth = _mm256_set1_epi8(char(0xF0 - 0x80));
+
+				__m256i prev = _mm256_setzero_si256();
+				bool prevASCII = true;
+				for (; end - it >= 32; it += 32)
+				{
+					const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(it));
+					const bool ascii = _mm256_movemask_epi8(v) == 0;
+					// A block after a non-ASCII one is still checked, it might have to finish a sequence
+					if (!(ascii && prevASCII))
+					{
+						// Bytes 1, 2 & 3 positions earlier, the first ones come from the previous block
+						const __m256i carried = _mm256_permute2x128_si256(prev, v, 0x21);
+						const __m256i prev1 = _mm256_alignr_epi8(v, carried, 15);
+						const __m256i prev2 = _mm256_alignr_epi8(v, carried, 14);
+						const __m256i prev3 = _mm256_alignr_epi8(v, carried, 13);
+
+						const __m256i special = _mm256_and_si256(
+							_mm256_and_si256(
+								_mm256_shuffle_epi8(byte1High, _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble)),
+								_mm256_shuffle_epi8(byte1Low, _mm256_and_si256(prev1, nibble))
+							),
+							_mm256_shuffle_epi8(byte2High, _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble))
+						);
+						// Continuation bytes expected after a 3 or 4 byte lead have to be exactly those flagged twoConts
+						const __m256i must23 = _mm256_and_si256(
+							_mm256_or_si256(_mm256_subs_epu8(prev2, third), _mm256_subs_epu8(prev3, fourth)),
+							high
+						);
+						const __m256i error = _mm256_xor_si256(must23, special);
+						if (!_mm256_testz_si256(error, error))
+						{
+							return it;
+						}
+					}
+					prev      = v;
+					prevASCII = ascii;
+				}
+				return it;
+			}
+#endif
 
-		xml(const char * xmlFile, std::size_t length)
-		{
-			length = strlen(xmlFile, length);
-			std::string file;
-			
-			const char * start = xmlFile;
-			if (getBOM(xmlFile, length) != -1)
+			template<bool Invert>
+			inline const char * scan(const char * it, const char * end, char a, char b, char c, char d) noexcept
 			{
-				file   = convertDOM(xmlFile, length);
-				start  = file.c_str();
-				length = file.length();
+#if defined(XMLITE_X86_SIMD)
+				// Empty runs are common (text right before a tag, no whitespace to skip)
+				if (it != end && (*it == a || *it == b || *it == c || *it == d) != Invert)
+				{
+					return it;
+				}
+				if (end - it >= 64)
+				{
+					// Most runs are settled by the first SSE2 steps, wider vectors only pay off once a run turned out to be long
+					const char * window = it + 64;
+					it = scanSSE2<Invert>(it, window, a, b, c, d);
+					if (it != window)
+					{
+						return it;
+					}
+					switch (cpuLevel())
+					{
+					case level::AVX512:
+						it = scanAVX512<Invert>(it, end, a, b, c, d);
+						break;
+					case level::AVX2:
+						it = scanAVX2<Invert>(it, end, a, b, c, d);
+						break;
+					default:
+						it = scanSSE2<Invert>(it, end, a, b, c, d);
+						break;
+					}
+				}
+				else if (end - it >= 16)
+				{
+					it = scanSSE2<Invert>(it, end, a, b, c, d);
+				}
+#endif
+				for (; it != end && (*it == a || *it == b || *it == c || *it == d) == Invert; ++it);
+				return it;
 			}
+		}
 
-			this->m_ver        = getVersion(start, length, this->m_verInit);
-			this->m_encoding   = getEncoding(xmlFile, length, this->m_encInit);
-			this->m_standalone = getStandalone(start, length, this->m_saInit);
-			this->m_nodes      = { start, length };
+		// These return end if nothing was found
+		inline const char * findChar(const char * it, const char * end, char ch) noexcept
+		{
+			auto res = static_cast<const char *>(std::memchr(it, ch, std::size_t(end - it)));
+			return res != nullptr ? res : end;
 		}
-		xml(const char * xmlFile)
-			: xml(xmlFile, std::char_traits<char>::length(xmlFile))
+		inline const char * findAny(const char * it, const char * end, char a, char b) noexcept
 		{
+			return simd::scan<false>(it, end, a, b, b, b);
 		}
-		xml(const std::string & xmlFile)
-			: xml(xmlFile.c_str(), xmlFile.length())
+		inline const char * findAny(const char * it, const char * end, char a, char b, char c) noexcept
 		{
+			return simd::scan<false>(it, end, a, b, c, c);
+		}
+		// Words, separators & indentation are mostly short, the kernels only take over for longer runs
+		inline const char * findWhiteSpace(const char * it, const char * end) noexcept
+		{
+			for (const char * prefixEnd = end - it > 16 ? it + 16 : end; it != prefixEnd; ++it)
+			{
+				if (isWhiteSpace(*it))
+				{
+					return it;
+				}
+			}
+			return simd::scan<false>(it, end, ' ', '\n', '\t', '\r');
+		}
+		inline const char * findNonWhiteSpace(const char * it, const char * end) noexcept
+		{
+			for (const char * prefixEnd = end - it > 16 ? it + 16 : end; it != prefixEnd; ++it)
+			{
+				if (!isWhiteSpace(*it))
+				{
+					return it;
+				}
+			}
+			return simd::scan<true>(it, end, ' ', '\n', '\t', '\r');
 		}
-		xml(const xml & other) = default;
-		xml(xml && other) noexcept = default;
-		xml & operator=(const xml & other) = default;
-		xml & operator=(xml && other) noexcept = default;
 
-		operator xmlnode &()
+		/*
+		 * Same whitespace handling as the parser: runs become one space, trailing whitespace is dropped,
+		 * the state carries over between consecutive pieces of the same text
+		 */
+		inline void collapseWhiteSpace(std::string & out, const char * str, std::size_t len, bool & prevWhiteSpace)
 		{
-			return this->m_nodes;
+			for (const char * end = str + len; str != end;)
+			{
+				const char * ws = findWhiteSpace(str, end);
+				if (ws != str)
+				{
+					if (prevWhiteSpace)
+					{
+						out += ' ';
+						prevWhiteSpace = false;
+					}
+					out.append(str, ws);
+				}
+				if (ws == end)
+				{
+					break;
+				}
+				prevWhiteSpace = true;
+				str = findNonWhiteSpace(ws, end);
+			}
 		}
-		operator const xmlnode &() const
+		inline void collapseWhiteSpace(std::string & out, const char * str, std::size_t len)
 		{
-			return this->m_nodes;
+			bool prevWhiteSpace = false;
+			collapseWhiteSpace(out, str, len, prevWhiteSpace);
 		}
-		xmlnode & get()
+
+		// Writes at most 4 bytes, code points above 0x1FFFFF aren't representable
+		inline char * encodeUTF8(char * out, std::uint32_t c) noexcept
 		{
-			return this->m_nodes;
+			if (c <= 0x7F)
+			{
+				*out++ = char(c);
+			}
+			else if (c <= 0x07FF)
+			{
+				*out++ = char(0xC0 | ((c >> 6) & 0x1F));
+				*out++ = char(0x80 | (c        & 0x3F));
+			}
+			else if (c <= 0xFFFF)
+			{
+				*out++ = char(0xE0 | ((c >> 12) & 0x0F));
+				*out++ = char(0x80 | ((c >> 6)  & 0x3F));
+				*out++ = char(0x80 | (c         & 0x3F));
+			}
+			else
+			{
+				*out++ = char(0xF0 | ((c >> 18) & 0x07));
+				*out++ = char(0x80 | ((c >> 12) & 0x3F));
+				*out++ = char(0x80 | ((c >> 6)  & 0x3F));
+				*out++ = char(0x80 | (c         & 0x3F));
+			}
+			return out;
 		}
 
-		std::string getVersion() const
+		constexpr std::uint32_t replacementChar = 0xFFFD;
+
+		/*
+		 * Returns the first byte of the first ill-formed UTF-8 sequence, end if there is none.
+		 * Overlong forms, surrogates & code points above U+10FFFF are all rejected
+		 */
+		inline const char * findInvalidUTF8Scalar(const char * it, const char * end) noexcept
 		{
-			return versionStr[underlying_cast(this->m_ver)];
+			while (it != end)
+			{
+#if defined(XMLITE_X86_SIMD)
+				it = simd::skipASCII(it, end);
+#else
+				for (std::uint64_t word; end - it >= 8; it += 8)
+				{
+					std::memcpy(&word, it, 8);
+					if ((word & 0x8080808080808080U) != 0)
+					{
+						break;
+					}
+				}
+#endif
+				for (; it != end && std::uint8_t(*it) < 0x80; ++it);
+				if (it == end)
+				{
+					break;
+				}
+
+				// Range of the second byte depends on the lead byte, the rest are plain continuation bytes
+				const std::uint8_t lead = std::uint8_t(*it);
+				std::size_t len;
+				std::uint8_t lo = 0x80, hi = 0xBF;
+				if (lead >= 0xC2 && lead <= 0xDF)
+				{
+					len = 2;
+				}
+				else if (lead >= 0xE0 && lead <= 0xEF)
+				{
+					len = 3;
+					lo  = lead == 0xE0 ? 0xA0 : lo;
+					hi  = lead == 0xED ? 0x9F : hi;
+				}
+				else if (lead >= 0xF0 && lead <= 0xF4)
+				{
+					len = 4;
+					lo  = lead == 0xF0 ? 0x90 : lo;
+					hi  = lead == 0xF4 ? 0x8F : hi;
+				}
+				else
+				{
+					return it;
+				}
+
+				if (std::size_t(end - it) < len)
+				{
+					return it;
+				}
+				auto b = reinterpret_cast<const std::uint8_t *>(it);
+				if (b[1] < lo || b[1] > hi)
+				{
+					return it;
+				}
+				for (std::size_t i = 2; i < len; ++i)
+				{
+					if ((b[i] & 0xC0) != 0x80)
+					{
+						return it;
+					}
+				}
+				it += len;
+			}
+			return end;
 		}
-		std::string getEncoding() const
+		inline const char * findInvalidUTF8(const char * it, const char * end) noexcept
 		{
-			return this->m_encoding;
+#if defined(XMLITE_X86_SIMD)
+			if (end - it >= 64 && simd::cpuLevel() >= simd::level::AVX2)
+			{
+				// The vector pass only tells which block is bad, the scalar one finds the exact sequence
+				const char * stop = simd::utf8AVX2(it, end);
+				const char * from = stop - it > 3 ? stop - 3 : it;
+				for (; from != stop && (std::uint8_t(*from) & 0xC0) == 0x80; ++from);
+				it = from;
+			}
+#endif
+			return findInvalidUTF8Scalar(it, end);
 		}
-		std::string getStandalone() const
+
+		/*
+		 * Takes the position after '&', returns the position after the terminating ';' or nullptr
+		 * if there's no valid reference. Character references to code points that can't be encoded give U+FFFD
+		 */
+		inline const char * entityRef(const char * it, const char * end, std::uint32_t & c) noexcept
 		{
-			return this->m_standalone ? "yes" : "no";
+			auto named = [](const char * it, const char * end, const char * name, std::size_t len)
+			{
+				return std::size_t(end - it) >= len && std::memcmp(it, name, len) == 0 ? it + len : nullptr;
+			};
+
+			if (it == end)
+			{
+				return nullptr;
+			}
+			switch (*it)
+			{
+			case 'l':
+				c = '<';
+				return named(it, end, "lt;", 3);
+			case 'g':
+				c = '>';
+				return named(it, end, "gt;", 3);
+			case 'q':
+				c = '"';
+				return named(it, end, "quot;", 5);
+			case 'a':
+				if (const char * next = named(it, end, "amp;", 4))
+				{
+					c = '&';
+					return next;
+				}
+				c = '\'';
+				return named(it, end, "apos;", 5);
+			case '#':
+				break;
+			default:
+				return nullptr;
+			}
+
+			++it;
+			const bool hex = it != end && *it == 'x';
+			it += hex;
+			const char * digits = it;
+			// Saturates past the last code point, so long runs of digits can't overflow
+			std::uint32_t value = 0;
+			for (; it != end; ++it)
+			{
+				std::uint32_t d;
+				if (*it >= '0' && *it <= '9')
+				{
+					d = std::uint32_t(*it - '0');
+				}
+				else if (hex && (*it | 0x20) >= 'a' && (*it | 0x20) <= 'f')
+				{
+					d = std::uint32_t((*it | 0x20) - 'a' + 10);
+				}
+				else
+				{
+					break;
+				}
+				value = value > 0x10FFFF ? value : value * (hex ? 16 : 10) + d;
+			}
+			if (it == digits || it == end || *it != ';')
+			{
+				return nullptr;
+			}
+			c = value == 0 || value > 0x10FFFF || (value >= 0xD800 && value <= 0xDFFF) ? replacementChar : value;
+			return it + 1;
 		}
 
-		static inline version getVersion(const char * xmlFile, std::size_t length, bool & init);
-		static inline std::string getEncoding(const char * xmlFile, std::size_t length, bool & init);
-		static inline bool getStandalone(const char * xmlFile, std::size_t length, bool & init);
-		static inline std::int8_t getBOM(const char * xmlFile, std::size_t length);
+		/*
+		 * Resolves entity & character references, anything that isn't a valid reference is copied as-is.
+		 * The output is never longer than the input, so out may be the input itself (decoding in place)
+		 */
+		inline char * decodeEntities(char * out, const char * it, const char * end) noexcept
+		{
+			while (true)
+			{
+				const char * amp = findChar(it, end, '&');
+				if (out != it)
+				{
+					std::memmove(out, it, std::size_t(amp - it));
+				}
+				out += amp - it;
+				if (amp == end)
+				{
+					return out;
+				}
 
-		std::string dumpHeader() const
+				std::uint32_t c;
+				const char * next = entityRef(amp + 1, end, c);
+				if (next == nullptr)
+				{
+					*out++ = '&';
+					it = amp + 1;
+				}
+				else
+				{
+					out = encodeUTF8(out, c);
+					it  = next;
+				}
+			}
+		}
+		inline void decodeEntities(std::string & str)
 		{
-			std::string str = "<?xml";
+			if (std::memchr(str.data(), '&', str.size()) != nullptr)
+			{
+				str.resize(std::size_t(decodeEntities(&str[0], str.data(), str.data() + str.size()) - str.data()));
+			}
+		}
 
-			str += " version=\"";
-			str += versionStr[underlying_cast(this->m_ver)];
-			str += '"';
+		// Sinks for the serializer, the first pass can measure the output so the buffer is allocated once
+		struct sizecounter
+		{
+			std::size_t size{ 0 };
 
-			if (this->m_saInit)
+			void put(char) noexcept
 			{
-				str += " standalone=";
-				str += this->m_standalone ? "\"yes\"" : "\"no\"";
+				++this->size;
+			}
+			void put(const char *, std::size_t len) noexcept
+			{
+				this->size += len;
+			}
+			void fill(char, std::size_t num) noexcept
+			{
+				this->size += num;
 			}
+		};
+		struct stringwriter
+		{
+			std::string & out;
 
-			str += "?>";
-			return str;
-		}
+			void put(char ch)
+			{
+				this->out += ch;
+			}
+			void put(const char * str, std::size_t len)
+			{
+				this->out.append(str, len);
+			}
+			void fill(char ch, std::size_t num)
+			{
+				this->out.append(num, ch);
+			}
+		};
 
-		std::string dump() const
+		// Text or an attribute value with '<', '&', '>' & '"' replaced by references, clean runs are put whole
+		template<typename Sink>
+		inline void escape(Sink & sink, const char * it, const char * end)
+		{
+			while (true)
+			{
+				const char * special = simd::scan<false>(it, end, '<', '&', '>', '"');
+				sink.put(it, std::size_t(special - it));
+				if (special == end)
+				{
+					return;
+				}
+				switch (*special)
+				{
+				case '<':
+					sink.put("&lt;", 4);
+					break;
+				case '&':
+					sink.put("&amp;", 5);
+					break;
+				case '>':
+					sink.put("&gt;", 4);
+					break;
+				default:
+					sink.put("&quot;", 6);
+					break;
+				}
+				it = special + 1;
+			}
+		}
+		// A value in escaped form is put as it is, except for what would make it invalid: '<', '"' in
+		// attribute values and '&' that doesn't start a reference
+		template<typename Sink>
+		inline void escapeInvalid(Sink & sink, const char * it, const char * end, bool attr)
+		{
+			while (true)
+			{
+				const char * special = attr ? findAny(it, end, '<', '&', '"') : findAny(it, end, '<', '&');
+				std::uint32_t c;
+				const char * ref = special != end && *special == '&' ? entityRef(special + 1, end, c) : nullptr;
+				if (ref != nullptr)
+				{
+					sink.put(it, std::size_t(ref - it));
+					it = ref;
+					continue;
+				}
+				sink.put(it, std::size_t(special - it));
+				if (special == end)
+				{
+					return;
+				}
+				switch (*special)
+				{
+				case '<':
+					sink.put("&lt;", 4);
+					break;
+				case '&':
+					sink.put("&amp;", 5);
+					break;
+				default:
+					sink.put("&quot;", 6);
+					break;
+				}
+				it = special + 1;
+			}
+		}
+
+		// Number formatting into a caller's buffer of at least 32 bytes, returns the length,
+		// independent of the C locale
+		template<typename T>
+		inline std::size_t formatInteger(char * buf, T value, std::false_type) noexcept
+		{
+			char digits[24];
+			char * it = digits + sizeof digits;
+			do
+			{
+				*--it = char('0' + value % 10);
+				value = T(value / 10);
+			} while (value != 0);
+			const std::size_t len = std::size_t(digits + sizeof digits - it);
+			std::memcpy(buf, it, len);
+			return len;
+		}
+		template<typename T>
+		inline std::size_t formatInteger(char * buf, T value, std::true_type) noexcept
+		{
+			using U = typename std::make_unsigned<T>::type;
+			if (value >= 0)
+			{
+				return formatInteger(buf, U(value), std::false_type());
+			}
+			*buf = '-';
+			return 1 + formatInteger(buf + 1, U(U(0) - U(value)), std::false_type());
+		}
+		inline std::size_t formatNumber(char * buf, double value) noexcept
+		{
+			// Lexical forms of xsd:double
+			if (value != value)
+			{
+				std::memcpy(buf, "NaN", 3);
+				return 3;
+			}
+			else if (value > 1.7976931348623157e308 || value < -1.7976931348623157e308)
+			{
+				std::memcpy(buf, value < 0 ? "-INF" : "INF", value < 0 ? 4 : 3);
+				return value < 0 ? 4 : 3;
+			}
+			// Whole numbers are exact as integers, which is a lot cheaper than printf
+			if (value > -9007199254740992.0 && value < 9007199254740992.0 && value == double(std::int64_t(value)))
+			{
+				return formatInteger(buf, std::int64_t(value), std::true_type());
+			}
+			// The shortest of the two precisions that reads back as the same value, printf and strtod
+			// both follow the C locale so the check holds whatever its decimal separator is
+			std::size_t len = std::size_t(std::snprintf(buf, 32, "%.15g", value));
+			if (std::strtod(buf, nullptr) != value)
+			{
+				len = std::size_t(std::snprintf(buf, 32, "%.17g", value));
+			}
+			// xsd:double always uses '.', the separator of the locale (it may be several bytes) is
+			// whatever is between the digits
+			char * sep = buf + (*buf == '-');
+			while (*sep >= '0' && *sep <= '9')
+			{
+				++sep;
+			}
+			if (sep != buf + len && *sep != 'e')
+			{
+				char * next = sep + 1;
+				while (next != buf + len && (*next < '0' || *next > '9') && *next != 'e')
+				{
+					++next;
+				}
+				*sep = '.';
+				std::memmove(sep + 1, next, std::size_t(buf + len - next));
+				len -= std::size_t(next - sep - 1);
+			}
+			return len;
+		}
+		inline std::size_t formatNumber(char * buf, bool value) noexcept
+		{
+			std::memcpy(buf, value ? "true" : "false", value ? 4 : 5);
+			return value ? 4 : 5;
+		}
+		template<typename T>
+		inline typename std::enable_if<std::is_integral<T>::value, std::size_t>::type formatNumber(char * buf, T value) noexcept
+		{
+			return formatInteger(buf, value, std::is_signed<T>());
+		}
+		template<typename T>
+		inline typename std::enable_if<std::is_floating_point<T>::value, std::size_t>::type formatNumber(char * buf, T value) noexcept
+		{
+			return formatNumber(buf, double(value));
+		}
+
+		/*
+		 * Fixed-size output buffer, handed to the flush callback whenever it's full.
+		 * Writes longer than the buffer go to the callback directly
+		 */
+		class outbuffer
+		{
+		private:
+			std::function<void(const char *, std::size_t)> m_flush;
+			std::unique_ptr<char[]> m_buf;
+			std::size_t m_size, m_used{ 0 };
+
+		public:
+			outbuffer(std::function<void(const char *, std::size_t)> flush, std::size_t size)
+				: m_flush(std::move(flush)), m_buf(new char[size != 0 ? size : 1]), m_size(size != 0 ? size : 1)
+			{
+			}
+			outbuffer(const outbuffer & other) = delete;
+			// A moved-from buffer has nothing left to flush
+			outbuffer(outbuffer && other) noexcept
+				: m_flush(std::move(other.m_flush)), m_buf(std::move(other.m_buf)), m_size(other.m_size), m_used(other.m_used)
+			{
+				other.m_used = 0;
+			}
+			outbuffer & operator=(const outbuffer & other) = delete;
+			outbuffer & operator=(outbuffer && other) noexcept
+			{
+				this->m_flush = std::move(other.m_flush);
+				this->m_buf   = std::move(other.m_buf);
+				this->m_size  = other.m_size;
+				this->m_used  = other.m_used;
+				other.m_used = 0;
+				return *this;
+			}
+
+			void flush()
+			{
+				if (this->m_used != 0)
+				{
+					const std::size_t used = this->m_used;
+					this->m_used = 0;
+					this->m_flush(this->m_buf.get(), used);
+				}
+			}
+			void put(char ch)
+			{
+				if (this->m_used == this->m_size)
+				{
+					this->flush();
+				}
+				this->m_buf[this->m_used++] = ch;
+			}
+			void put(const char * str, std::size_t len)
+			{
+				if (len > this->m_size - this->m_used)
+				{
+					this->flush();
+					if (len >= this->m_size)
+					{
+						this->m_flush(str, len);
+						return;
+					}
+				}
+				std::memcpy(this->m_buf.get() + this->m_used, str, len);
+				this->m_used += len;
+			}
+			void fill(char ch, std::size_t num)
+			{
+				while (num != 0)
+				{
+					if (this->m_used == this->m_size)
+					{
+						this->flush();
+					}
+					const std::size_t n = num < this->m_size - this->m_used ? num : this->m_size - this->m_used;
+					std::memset(this->m_buf.get() + this->m_used, ch, n);
+					this->m_used += n;
+					num -= n;
+				}
+			}
+		};
+
+		// Writes everything unless an error other than an interruption occurs
+		inline bool writeAll(int fd, const char * data, std::size_t len) noexcept
+		{
+			while (len != 0)
+			{
+#if defined(_WIN32)
+				const int chunk = len > 0x40000000 ? 0x40000000 : int(len);
+				const auto written = ::_write(fd, data, unsigned(chunk));
+#else
+				const auto written = ::write(fd, data, len);
+#endif
+				if (written < 0)
+				{
+					if (errno == EINTR)
+					{
+						continue;
+					}
+					return false;
+				}
+				data += written;
+				len  -= std::size_t(written);
+			}
+			return true;
+		}
+
+
+		// Code units are assembled from bytes, so neither alignment nor the host's byte order matter
+		template<std::size_t Size, bool BigEndian>
+		inline std::uint32_t readUnit(const char * p) noexcept
+		{
+			auto b = reinterpret_cast<const std::uint8_t *>(p);
+			std::uint32_t unit = 0;
+			for (std::size_t i = 0; i < Size; ++i)
+			{
+				unit |= std::uint32_t(b[i]) << (8 * (BigEndian ? Size - 1 - i : i));
+			}
+			return unit;
+		}
+		inline bool hostBigEndian() noexcept
+		{
+			const std::uint16_t probe = 1;
+			std::uint8_t first;
+			std::memcpy(&first, &probe, 1);
+			return first == 0;
+		}
+
+		// Sinks for decodeUTF, the first pass measures the output so the second one can fill an exact buffer
+		struct utf8counter
+		{
+			std::size_t size{ 0 };
+			char scratch[16];
+
+			char * ascii() noexcept
+			{
+				return this->scratch;
+			}
+			void advance(std::size_t n) noexcept
+			{
+				this->size += n;
+			}
+			void put(std::uint32_t c) noexcept
+			{
+				this->size += c <= 0x7F ? 1 : c <= 0x07FF ? 2 : c <= 0xFFFF ? 3 : 4;
+			}
+		};
+		struct utf8writer
+		{
+			char * out;
+
+			char * ascii() noexcept
+			{
+				return this->out;
+			}
+			void advance(std::size_t n) noexcept
+			{
+				this->out += n;
+			}
+			void put(std::uint32_t c) noexcept
+			{
+				this->out = encodeUTF8(this->out, c);
+			}
+		};
+
+		/*
+		 * Decodes UTF-16 (Size 2) or UTF-32 (Size 4) code units, invalid ones become U+FFFD.
+		 * Unless final, stops before a trailing partial unit or a high surrogate that might be paired
+		 * in the next piece of input; returns the position where decoding stopped
+		 */
+		template<std::size_t Size, bool BigEndian, typename Sink>
+		inline const char * decodeUTF(const char * it, const char * end, Sink & sink, bool final) noexcept
+		{
+			while (std::size_t(end - it) >= Size)
+			{
+#if defined(XMLITE_X86_SIMD)
+				if (std::size_t(end - it) >= 16 * Size)
+				{
+					const std::size_t ascii = simd::asciiPrefix<Size, BigEndian>(it, sink.ascii());
+					sink.advance(ascii);
+					it += ascii * Size;
+					if (ascii == 16)
+					{
+						continue;
+					}
+				}
+#endif
+				std::uint32_t c = readUnit<Size, BigEndian>(it);
+				if (Size == 2 && c >= 0xD800 && c <= 0xDFFF)
+				{
+					if (c <= 0xDBFF && std::size_t(end - it) < 4 && !final)
+					{
+						break;
+					}
+					const std::uint32_t c2 = c <= 0xDBFF && std::size_t(end - it) >= 4 ? readUnit<Size, BigEndian>(it + 2) : 0;
+					if (c2 >= 0xDC00 && c2 <= 0xDFFF)
+					{
+						c = ((c - 0xD800) << 10) + (c2 - 0xDC00) + 0x10000;
+						it += 2;
+					}
+					else
+					{
+						c = replacementChar;
+					}
+				}
+				else if (Size == 4 && (c > 0x10FFFF || (c >= 0xD800 && c <= 0xDFFF)))
+				{
+					c = replacementChar;
+				}
+				it += Size;
+				sink.put(c);
+			}
+			// A trailing partial code unit is dropped for good once the input is final
+			return final ? end : it;
+		}
+		template<std::size_t Size, bool BigEndian>
+		inline std::string transcode(const char * it, const char * end)
+		{
+			utf8counter counter;
+			decodeUTF<Size, BigEndian>(it, end, counter, true);
+
+			std::string utf8;
+			utf8.resize(counter.size + 16);
+			utf8writer writer{ &utf8[0] };
+			decodeUTF<Size, BigEndian>(it, end, writer, true);
+			utf8.resize(counter.size);
+			return utf8;
+		}
+
+		// FNV-1a, only used for name tables
+		struct strviewHash
+		{
+			std::size_t operator()(strview str) const noexcept
+			{
+				std::uint32_t hash = 2166136261u;
+				for (char ch : str)
+				{
+					hash = (hash ^ std::uint8_t(ch)) * 16777619u;
+				}
+				return hash;
+			}
+		};
+
+		/*
+		 * Owning pointer that const code may set once while other threads read it: a value is built aside
+		 * & published with a compare-exchange, a thread that loses the race frees its own and uses the winner's
+		 */
+		template<typename T>
+		class lazyptr
+		{
+		private:
+			mutable std::atomic<T *> m_ptr{ nullptr };
+
+		public:
+			lazyptr() noexcept = default;
+			lazyptr(const lazyptr & other)
+				: m_ptr(other.get() != nullptr ? new T(*other.get()) : nullptr)
+			{
+			}
+			lazyptr(lazyptr && other) noexcept
+				: m_ptr(other.m_ptr.exchange(nullptr, std::memory_order_relaxed))
+			{
+			}
+			lazyptr & operator=(const lazyptr & other) = delete;
+			lazyptr & operator=(lazyptr && other) noexcept
+			{
+				if (this != &other)
+				{
+					this->reset(other.m_ptr.exchange(nullptr, std::memory_order_relaxed));
+				}
+				return *this;
+			}
+			~lazyptr()
+			{
+				delete this->m_ptr.load(std::memory_order_relaxed);
+			}
+
+			T * get() const noexcept
+			{
+				return this->m_ptr.load(std::memory_order_acquire);
+			}
+			T * operator->() const noexcept
+			{
+				return this->get();
+			}
+			// Not for concurrent use, like any other modification
+			void reset(T * ptr = nullptr) noexcept
+			{
+				delete this->m_ptr.exchange(ptr, std::memory_order_acq_rel);
+			}
+			// Returns the value that was kept, which is ptr unless another thread published first
+			T * publish(std::unique_ptr<T> ptr) const noexcept
+			{
+				T * expected = nullptr;
+				if (this->m_ptr.compare_exchange_strong(expected, ptr.get(), std::memory_order_acq_rel, std::memory_order_acquire))
+				{
+					return ptr.release();
+				}
+				return expected;
+			}
+		};
+
+		// Smaller documents aren't worth starting threads for
+		constexpr std::size_t parallelMinSize = 1024 * 1024;
+
+		// Nesting that can't be resolved inside a chunk of a document, checked once the chunks before it are known
+		struct chunkedges
+		{
+			enum class kind : std::uint8_t
+			{
+				// XML declaration
+				Header,
+				// Start tag while no element of the chunk was open
+				Root,
+				// End tag of an element opened in an earlier chunk
+				Close
+			};
+			struct edge
+			{
+				kind type;
+				std::size_t nameStart, nameLen;
+			};
+			// In document order
+			std::vector<edge> edges;
+			std::string names;
+
+			// Elements still open at the end of the chunk, outermost first
+			std::string openNames;
+			std::vector<std::size_t> openStarts;
+		};
+
+		/*
+		 * Splits XML into start tag, end tag, text, CDATA and comment events in a single pass,
+		 * every event is passed to the handler as a pointer to the original buffer.
+		 * Checks the document for well-formedness on the way, unless told otherwise
+		 */
+		template<typename Handler>
+		class tokenizer
+		{
+		private:
+			Handler & m_handler;
+			std::vector<attrview> m_attrs;
+
+			bool m_validate;
+			bool m_header{ false };
+			std::size_t m_roots{ 0 };
+			// Names of the open elements one after another, they outlive the buffer they came from
+			std::string m_tagNames;
+			std::vector<std::size_t> m_tagStarts;
+			// Only a chunk of the document is run, whatever depends on the chunks before it is recorded
+			chunkedges * m_edges{ nullptr };
+			// Length of the cut construct the last run returned that's known not to hold its end
+			std::size_t m_resume{ 0 };
+
+		public:
+			explicit tokenizer(Handler & handler, bool validate = true) noexcept
+				: m_handler(handler), m_validate(validate)
+			{
+			}
+
+			/*
+			 * Unless it's the final piece of the document, a construct cut by the end isn't reported;
+			 * returns where it starts so it can be run again once more input is there. That run has to
+			 * start with the cut construct, the search for its end picks up where it stopped
+			 */
+			inline const char * run(const char * start, const char * end, bool final = true);
+
+			void chunked(chunkedges * edges) noexcept
+			{
+				this->m_edges = edges;
+			}
+			void leaveOpen(chunkedges & edges) noexcept
+			{
+				edges.openNames.swap(this->m_tagNames);
+				edges.openStarts.swap(this->m_tagStarts);
+			}
+			// Ready for another document, the buffers keep their capacity
+			void reset() noexcept
+			{
+				this->m_attrs.clear();
+				this->m_header = false;
+				this->m_roots  = 0;
+				this->m_tagNames.clear();
+				this->m_tagStarts.clear();
+				this->m_resume = 0;
+			}
+		};
+
+		template<typename Handler>
+		class feeder;
+	}
+
+	class exception : public std::exception
+	{
+	private:
+		friend class xmlnode;
+		friend class xml;
+		friend class xmldoc;
+		friend class writer;
+		friend class mappedfile;
+		template<typename Handler>
+		friend class inner::tokenizer;
+		template<typename Handler>
+		friend class inner::feeder;
+		friend void check(const char * xmlFile, std::size_t length, const parseOptions & options);
+		
+		enum class Type : std::uint_fast8_t
+		{
+			Unknown,
+			NotAnEndpoint,
+			OutOfBounds,
+
+			ParseIncorrectHeader,
+			ParseIncorrectHeaderTerminator,
+			ParseIncorrectTag,
+			ParseIncorrectComment,
+			ParseIncorrectEscapeCharacter,
+			ParseNoTerminatingTag,
+			ParseNoTerminatingQuote,
+			ParseTooManyRoots,
+			ParseNoRoot,
+			ParseComment2Dashes,
+			ParseInvalidUTF8,
+
+			WriteIncorrectNesting,
+			WriteIncorrectOrder,
+			WriteFailed,
+
+			FileOpenFailed,
+
+			enum_size
+		};
+
+		Type m_type;
+		std::string m_optMsg;
+		static constexpr const char * exceptionMessages[underlying_cast(Type::enum_size)]
+		{
+			"Unknown exception.",
+			"This is not an end-point in the object structure!",
+			"The array does not contain an item at this index!",
+
+			"Incorrect XML header!",
+			"Incorrect XML header terminator!",
+			"Incorrect tag!",
+			"Incorrect comment format!",
+			"Incorrect escape character!",
+			"No tag terminator found!",
+			"No terminating '\"' found!",
+			"Too many root elements!",
+			"No root element found!",
+			"2 dashes found in the middle of comment!",
+			"Invalid UTF-8 sequence!",
+
+			"End tag doesn't match the open element!",
+			"Not allowed at this point of the document!",
+			"Writing to the output failed!",
+
+			"Couldn't open or map the file!"
+		};
+		std::size_t m_offset{ noOffset };
+	public:
+		static constexpr std::size_t noOffset = std::size_t(-1);
+
+		explicit exception(Type type = Type::Unknown) noexcept
+			: m_type(type)
+		{
+		}
+		explicit exception(Type type, const char * extra, std::size_t extraLen)
+			: m_type(type), m_optMsg(this->exceptionMessages[underlying_cast(type)] +
+				std::string(" At: \"") + std::string{ extra, strlen(extra, extraLen) } + '\"')
+		{
+		}
+		explicit exception(Type type, std::size_t offset)
+			: m_type(type), m_optMsg(this->exceptionMessages[underlying_cast(type)] +
+				std::string(" At byte: ") + std::to_string(offset)), m_offset(offset)
+		{
+		}
+
+		// Byte offset in the input, noOffset unless the error is tied to one
+		std::size_t offset() const noexcept
+		{
+			return this->m_offset;
+		}
+
+		virtual const char * what() const throw() override
+		{
+			if (this->m_optMsg.empty())
+			{
+				return this->exceptionMessages[underlying_cast(this->m_type)];
+			}
+			else
+			{
+				return this->m_optMsg.c_str();
+			}
+		}
+
+	};
+
+	constexpr const char * exception::exceptionMessages[];
+	constexpr std::size_t exception::noOffset;
+
+	/*
+	 * Element or text node of a document tree. The child index used by lookups by name is built lazily
+	 * by the first one, const access from several threads is still safe as long as nobody modifies the tree
+	 */
+	class xmlnode
+	{
+	public:
+		using String = std::string;
+		template<typename T, typename U>
+		using HashMap = std::unordered_map<T, U>;
+		template<typename T>
+		using Vec = std::vector<T>;
+
+		using IdxVec = Vec<std::size_t>;
+
+		using AttrMap = HashMap<String, String>;
+		using ValueVec = Vec<xmlnode>;
+		using IdxMap = HashMap<String, IdxVec>;
+
+	private:
+		friend class xmldoc;
+		friend class nodeparser;
+		friend class batchparser;
+
+		// Tag name, or the character data of a text node
+		String m_tag;
+		ValueVec m_values;
+
+		struct elemdata
+		{
+			AttrMap attributes;
+			// Child index by tag, only built once something is looked up by name
+			inner::lazyptr<IdxMap> idxMap;
+		};
+		// Allocated on first use, text nodes & elements without attributes don't carry any maps
+		inner::lazyptr<elemdata> m_elem;
+
+		enum class objtype : std::uint8_t
+		{
+			EmptyObject,
+			Object,
+			EndPoint
+		};
+		objtype m_role{ objtype::EmptyObject };
+		/*
+		 * Text & attribute values are in escaped form, as they were written in the document (CDATA is escaped),
+		 * and are dumped as they are, only what isn't valid XML is escaped. Set by the parser unless values were
+		 * decoded; nodes created through add() & emplace() hold plain values, which are escaped when dumped
+		 */
+		bool m_escaped{ false };
+
+		static inline xmlnode innerParse(const char * xml, std::size_t len);
+		// Tree building handler of the single-pass tokenizer
+		struct builder;
+		static inline xmlnode innerParseLinear(const char * xml, std::size_t len, bool validate, bool decode);
+		// Children of the root are split into sections that are built on separate threads
+		static inline xmlnode innerParseParallel(const char * xml, std::size_t len, bool validate, bool decode, std::size_t threads);
+		// Marks the values of a parsed subtree as escaped, or resolves their references if asked to
+		inline void finishParse(bool decode);
+		template<typename Sink>
+		inline void dumpTo(Sink & sink, const dumpOptions & options) const;
+		
+		// Up to this many children are searched linearly instead of building the index
+		static constexpr std::size_t linearLookupMax = 8;
+
+		// Safe to call from const code on several threads, they all get the same data
+		elemdata & elem() const
+		{
+			elemdata * e = this->m_elem.get();
+			return e != nullptr ? *e : *this->m_elem.publish(std::unique_ptr<elemdata>(new elemdata()));
+		}
+		const AttrMap & attrs() const noexcept
+		{
+			static const AttrMap empty;
+			return this->m_elem.get() != nullptr ? this->m_elem->attributes : empty;
+		}
+
+		// Text nodes aren't indexed, nullptr if there wasn't enough memory
+		const IdxMap * buildIdxMap() const noexcept
+		{
+			try
+			{
+				std::unique_ptr<IdxMap> map(new IdxMap());
+				for (std::size_t i = 0, sz = this->m_values.size(); i < sz; ++i)
+				{
+					if (this->m_values[i].m_role != objtype::EndPoint)
+					{
+						(*map)[this->m_values[i].m_tag].push_back(i);
+					}
+				}
+				return this->elem().idxMap.publish(std::move(map));
+			}
+			catch (const std::exception &)
+			{
+				return nullptr;
+			}
+		}
+		IdxMap * builtIdxMap() const noexcept
+		{
+			return this->m_elem.get() != nullptr ? this->m_elem->idxMap.get() : nullptr;
+		}
+		bool idxInit() const noexcept
+		{
+			return this->builtIdxMap() != nullptr;
+		}
+		const IdxMap & idxMap() const noexcept
+		{
+			static const IdxMap empty;
+			const IdxMap * map = this->builtIdxMap();
+			if (map == nullptr)
+			{
+				map = this->buildIdxMap();
+			}
+			return map != nullptr ? *map : empty;
+		}
+		// Keeps an already built index up to date after appending a child
+		void indexChild(std::size_t idx)
+		{
+			IdxMap * map = this->builtIdxMap();
+			if (map != nullptr && this->m_values[idx].m_role != objtype::EndPoint)
+			{
+				(*map)[this->m_values[idx].m_tag].push_back(idx);
+			}
+		}
+		void resetIdxMap() noexcept
+		{
+			if (this->m_elem.get() != nullptr)
+			{
+				this->m_elem->idxMap.reset();
+			}
+		}
+
+	public:
+
+		xmlnode() noexcept = default;
+		xmlnode(const xmlnode & other)
+			: m_tag(other.m_tag), m_values(other.m_values),
+			m_elem(other.m_elem), m_role(other.m_role), m_escaped(other.m_escaped)
+		{
+		}
+		xmlnode(xmlnode && other) noexcept = default;
+		xmlnode & operator=(const xmlnode & other)
+		{
+			if (this != &other)
+			{
+				*this = xmlnode(other);
+			}
+			return *this;
+		}
+		xmlnode & operator=(xmlnode && other) noexcept = default;
+		~xmlnode() noexcept = default;
+
+		inline xmlnode(const char * xmlFile, std::size_t length, const parseOptions & options);
+		xmlnode(const char * xmlFile, std::size_t length)
+			: xmlnode(xmlFile, length, parseOptions())
+		{
+		}
+		xmlnode(const char * xmlFile)
+			: xmlnode(xmlFile, std::char_traits<char>::length(xmlFile))
+		{
+		}
+		xmlnode(const std::string & xmlFile)
+			: xmlnode(xmlFile.c_str(), xmlFile.length())
+		{
+		}
+		xmlnode(const std::string & xmlFile, const parseOptions & options)
+			: xmlnode(xmlFile.c_str(), xmlFile.length(), options)
+		{
+		}
+
+		// Appends the subtree to out
+		inline void dump(std::string & out, const dumpOptions & options) const;
+		std::string dump(const dumpOptions & options) const
+		{
+			std::string str;
+			this->dump(str, options);
+			return str;
+		}
+		std::string dump() const
+		{
+			return this->dump(dumpOptions());
+		}
+
+		String & tag() noexcept
+		{
+			return this->m_tag;
+		}
+		const String & tag() const noexcept
+		{
+			return this->m_tag;
+		}
+		explicit operator String & () noexcept
+		{
+			return this->m_tag;
+		}
+		explicit operator const String & () const noexcept
+		{
+			return this->m_tag;
+		}
+
+		bool isText() const noexcept
+		{
+			return this->m_role == objtype::EndPoint;
+		}
+		// Whether text & attribute values are stored in escaped form and dumped as they are
+		bool escaped() const noexcept
+		{
+			return this->m_escaped;
+		}
+		// Values that are known to be clean can be marked to skip escaping them in dumps
+		void escaped(bool value) noexcept
+		{
+			this->m_escaped = value;
+		}
+		// Character data of a text node, empty for elements
+		const String & text() const noexcept
+		{
+			static const String empty;
+			return this->isText() ? this->m_tag : empty;
+		}
+
+		AttrMap & attr()
+		{
+			return this->elem().attributes;
+		}
+		const AttrMap & attr() const noexcept
+		{
+			return this->attrs();
+		}
+		explicit operator AttrMap & ()
+		{
+			return this->elem().attributes;
+		}
+		explicit operator const AttrMap & () const noexcept
+		{
+			return this->attrs();
+		}
+
+		bool exists(const std::string & str) const noexcept
+		{
+			if (!this->idxInit() && this->m_values.size() <= linearLookupMax)
+			{
+				for (const auto & i : this->m_values)
+				{
+					if (i.m_role != objtype::EndPoint && i.m_tag == str)
+					{
+						return true;
+					}
+				}
+				return false;
+			}
+			const auto & map = this->idxMap();
+			return map.find(str) != map.end();
+		}
+		const IdxVec & at(const std::string & str) const
+		{
+			return this->idxMap().at(str);
+		}
+		const xmlnode & at(std::size_t idx) const
+		{
+			return this->m_values.at(idx);
+		}
+		const IdxVec & operator[](const std::string & str)
+		{
+			if (!this->exists(str))
+			{
+				this->emplace(str);
+			}
+			return this->idxMap().at(str);
+		}
+		xmlnode & operator[](std::size_t idx) noexcept
+		{
+			return this->m_values[idx];
+		}
+		const xmlnode & operator[](std::size_t idx) const noexcept
+		{
+			return this->m_values[idx];
+		}
+
+		// Builds the child index of every element in the subtree up front, instead of on the first lookup by name
+		void buildIndex() const
+		{
+			std::vector<const xmlnode *> stack{ this };
+			while (!stack.empty())
+			{
+				auto node = stack.back();
+				stack.pop_back();
+				if (node->m_role == objtype::EndPoint)
+				{
+					continue;
+				}
+				if (!node->idxInit())
+				{
+					node->buildIdxMap();
+				}
+				for (const auto & child : node->m_values)
+				{
+					stack.push_back(&child);
+				}
+			}
+		}
+
+		std::size_t numValues() const noexcept
+		{
+			return this->m_values.size();
+		}
+
+		void add(const std::string & value)
+		{
+			this->add(std::string(value));
+		}
+		void add(std::string && value)
+		{
+			auto idx = this->m_values.size();
+			this->m_values.emplace_back();
+			auto & obj = this->m_values.back();
+			obj.m_tag = std::move(value);
+			obj.m_role = objtype::EndPoint;
+			this->m_role = objtype::Object;
+			this->indexChild(idx);
+		}
+		void add(const std::string & key, const std::string & value)
+		{
+			this->add(std::string(key), std::string(value));
+		}
+		void add(std::string && key, std::string && value)
+		{
+			this->emplace(std::move(key)).add(std::move(value));
+		}
+		void add(const xmlnode & other)
+		{
+			this->add(xmlnode(other));
+		}
+		void add(xmlnode && other)
+		{
+			auto idx = this->m_values.size();
+			this->m_values.emplace_back(std::move(other));
+			this->m_role = objtype::Object;
+			this->indexChild(idx);
+		}
+		/*
+		 * Appends an empty child element and returns it for filling in place,
+		 * the reference is invalidated by the next insertion or removal
+		 */
+		xmlnode & emplace(std::string tag)
+		{
+			auto idx = this->m_values.size();
+			this->m_values.emplace_back();
+			auto & obj = this->m_values.back();
+			obj.m_tag = std::move(tag);
+			this->m_role = objtype::Object;
+			this->indexChild(idx);
+			return obj;
+		}
+		// Removes a child and hands over its whole subtree without copying it
+		xmlnode extract(std::size_t idx)
+		{
+			if (idx >= this->m_values.size())
+			{
+				throw exception(exception::Type::OutOfBounds);
+			}
+
+			xmlnode obj(std::move(this->m_values[idx]));
+			this->m_values.erase(this->m_values.begin() + idx);
+			this->resetIdxMap();
+			return obj;
+		}
+		bool remove(std::size_t idx) noexcept
+		{
+			if (idx >= this->m_values.size())
+			{
+				return false;
+			}
+
+			this->m_values.erase(this->m_values.begin() + idx);
+			this->resetIdxMap();
+			return true;
+		}
+
+	};
+
+	/*
+	 * Read-mostly document, nodes live in one contiguous array linked by 32-bit indices,
+	 * strings are bump-allocated from an arena, so destruction only frees a few blocks.
+	 * In view mode strings aren't copied at all, they point into the parsed buffer.
+	 * Character data is kept as-is (escaped) unless references are resolved while parsing,
+	 * runs consisting only of whitespace are not stored
+	 */
+	class xmldoc
+	{
+	public:
+		enum class nodetype : std::uint8_t
+		{
+			Element,
+			Text
+		};
+
+		/*
+		 * Element and attribute names are interned, equal names share one atom per document,
+		 * so lookups with a resolved atom only compare integers
+		 */
+		using atom = std::uint32_t;
+		static constexpr atom noAtom = atom(-1);
+
+		struct attribute
+		{
+			strview name, value;
+			atom nameAtom{ noAtom };
+			// The value still contains references, false if there were none or they were resolved while parsing
+			bool escaped{ false };
+
+			// Value with escape sequences resolved
+			std::string decoded() const
+			{
+				return this->escaped ? xmlite::escapeChars(this->value.data(), this->value.size()) : this->value.str();
+			}
+		};
+
+	private:
+		friend class xml;
+
+		// Nodes refer to each other by their index in the node array
+		using nodeidx = std::uint32_t;
+		static constexpr nodeidx npos = nodeidx(-1);
+
+		struct node
+		{
+			// Tag name of an element, character data of a text node
+			strview str;
+			// Range in the attribute array
+			std::uint32_t attrs{ 0 }, numAttrs{ 0 };
+			atom name{ noAtom };
+
+			nodeidx parent{ npos }, firstChild{ npos }, lastChild{ npos }, nextSibling{ npos }, prevSibling{ npos };
+			nodetype type{ nodetype::Element };
+			// Character data still contains references
+			bool escaped{ false };
+		};
+
+		/*
+		 * Nodes are stored contiguously in document order, the root is always the first one,
+		 * attributes of all elements share one array as well. Only strings live in the arena
+		 */
+		std::vector<node> m_nodes;
+		std::vector<attribute> m_attrs;
+		arena m_arena;
+
+		// Name table, names are stored once
+		std::vector<strview> m_names;
+		std::unordered_map<strview, atom, inner::strviewHash> m_atoms;
+
+		// Keeps the buffer referenced in view mode alive, if the document owns it
+		std::shared_ptr<const void> m_source;
+		bool m_views{ false };
+		// References were resolved while parsing
+		bool m_decoded{ false };
+
+		inline nodeidx newNode(nodeidx parent, nodetype type, strview str);
+		inline atom intern(const char * str, std::size_t len);
+		inline void build(const char * xml, std::size_t len, const parseOptions & options);
+		inline void clone(const xmldoc & other);
+
+	public:
+		class noderef
+		{
+		private:
+			const xmldoc * m_doc{ nullptr };
+			nodeidx m_idx{ npos };
+
+			const node & get() const noexcept
+			{
+				return this->m_doc->m_nodes[this->m_idx];
+			}
+			noderef with(nodeidx idx) const noexcept
+			{
+				return noderef(this->m_doc, idx);
+			}
+
+		public:
+			noderef() noexcept = default;
+			noderef(const xmldoc * doc, nodeidx idx) noexcept
+				: m_doc(doc), m_idx(idx)
+			{
+			}
+
+			explicit operator bool() const noexcept
+			{
+				return this->m_doc != nullptr && this->m_idx != npos;
+			}
+			friend bool operator==(noderef lhs, noderef rhs) noexcept
+			{
+				return lhs.m_doc == rhs.m_doc && lhs.m_idx == rhs.m_idx;
+			}
+			friend bool operator!=(noderef lhs, noderef rhs) noexcept
+			{
+				return !(lhs == rhs);
+			}
+
+			// Position in document order, the root has index 0
+			std::size_t index() const noexcept
+			{
+				return this->m_idx;
+			}
+
+			nodetype type() const noexcept
+			{
+				return this->get().type;
+			}
+			bool isElement() const noexcept
+			{
+				return this->get().type == nodetype::Element;
+			}
+			bool isText() const noexcept
+			{
+				return this->get().type == nodetype::Text;
+			}
+
+			strview tag() const noexcept
+			{
+				return this->isElement() ? this->get().str : strview();
+			}
+			strview text() const noexcept
+			{
+				return this->isText() ? this->get().str : strview();
+			}
+			// noAtom for text nodes
+			atom tagAtom() const noexcept
+			{
+				return this->get().name;
+			}
+			// Character data with whitespace collapsed & escape sequences resolved
+			inline std::string value() const;
+
+			std::size_t numAttrs() const noexcept
+			{
+				return this->get().numAttrs;
+			}
+			const attribute * attrBegin() const noexcept
+			{
+				return this->m_doc->m_attrs.data() + this->get().attrs;
+			}
+			const attribute * attrEnd() const noexcept
+			{
+				return this->attrBegin() + this->get().numAttrs;
+			}
+			const attribute * findAttr(strview name) const noexcept
+			{
+				for (auto it = this->attrBegin(), end = this->attrEnd(); it != end; ++it)
+				{
+					if (it->name == name)
+					{
+						return it;
+					}
+				}
+				return nullptr;
+			}
+			const attribute * findAttr(atom name) const noexcept
+			{
+				for (auto it = this->attrBegin(), end = this->attrEnd(); it != end; ++it)
+				{
+					if (it->nameAtom == name)
+					{
+						return it;
+					}
+				}
+				return nullptr;
+			}
+			strview attr(strview name) const noexcept
+			{
+				auto a = this->findAttr(name);
+				return a != nullptr ? a->value : strview();
+			}
+			strview attr(atom name) const noexcept
+			{
+				auto a = this->findAttr(name);
+				return a != nullptr ? a->value : strview();
+			}
+
+			noderef parent() const noexcept
+			{
+				return this->with(this->get().parent);
+			}
+			noderef firstChild() const noexcept
+			{
+				return this->with(this->get().firstChild);
+			}
+			noderef lastChild() const noexcept
+			{
+				return this->with(this->get().lastChild);
+			}
+			noderef nextSibling() const noexcept
+			{
+				return this->with(this->get().nextSibling);
+			}
+			noderef prevSibling() const noexcept
+			{
+				return this->with(this->get().prevSibling);
+			}
+
+			// First child element with the given tag
+			noderef child(strview tag) const noexcept
+			{
+				return this->child(this->m_doc->findAtom(tag));
+			}
+			noderef child(atom tag) const noexcept
+			{
+				return this->findFrom(this->get().firstChild, tag);
+			}
+			// Next sibling element with the given tag
+			noderef next(strview tag) const noexcept
+			{
+				return this->next(this->m_doc->findAtom(tag));
+			}
+			noderef next(atom tag) const noexcept
+			{
+				return this->findFrom(this->get().nextSibling, tag);
+			}
+
+		private:
+			noderef findFrom(nodeidx idx, atom tag) const noexcept
+			{
+				if (tag == noAtom)
+				{
+					return this->with(npos);
+				}
+				const auto & nodes = this->m_doc->m_nodes;
+				for (; idx != npos && nodes[idx].name != tag; idx = nodes[idx].nextSibling);
+				return this->with(idx);
+			}
+		};
+
+		xmldoc() noexcept = default;
+		xmldoc(const xmldoc & other)
+		{
+			this->clone(other);
+		}
+		xmldoc(xmldoc && other) noexcept = default;
+		xmldoc & operator=(const xmldoc & other)
+		{
+			if (this != &other)
+			{
+				*this = xmldoc(other);
+			}
+			return *this;
+		}
+		xmldoc & operator=(xmldoc && other) noexcept = default;
+		~xmldoc() noexcept = default;
+
+		inline xmldoc(const char * xmlFile, std::size_t length, const parseOptions & options);
+		xmldoc(const char * xmlFile, std::size_t length)
+			: xmldoc(xmlFile, length, parseOptions())
+		{
+		}
+		xmldoc(const std::string & xmlFile, const parseOptions & options)
+			: xmldoc(xmlFile.c_str(), xmlFile.length(), options)
+		{
+		}
+		xmldoc(const std::string & xmlFile)
+			: xmldoc(xmlFile.c_str(), xmlFile.length())
+		{
+		}
+
+		noderef root() const noexcept
+		{
+			return noderef(this, this->m_nodes.empty() ? npos : 0);
+		}
+		// Node by its index in document order, iterating over all indices walks the whole tree
+		noderef at(std::size_t idx) const
+		{
+			if (idx >= this->m_nodes.size())
+			{
+				throw exception(exception::Type::OutOfBounds);
+			}
+			return noderef(this, nodeidx(idx));
+		}
+		std::size_t numNodes() const noexcept
+		{
+			return this->m_nodes.size();
+		}
+		std::size_t numBlocks() const noexcept
+		{
+			return this->m_arena.numBlocks();
+		}
+		bool isView() const noexcept
+		{
+			return this->m_views;
+		}
+
+		// Atom of an element or attribute name, noAtom if the name doesn't occur in the document
+		atom findAtom(strview name) const noexcept
+		{
+			auto it = this->m_atoms.find(name);
+			return it != this->m_atoms.end() ? it->second : noAtom;
+		}
+		strview name(atom a) const noexcept
+		{
+			return a < this->m_names.size() ? this->m_names[a] : strview();
+		}
+		std::size_t numNames() const noexcept
+		{
+			return this->m_names.size();
+		}
+
+		// Builds an equivalent xmlnode tree, character data gets its whitespace collapsed
+		inline xmlnode toNode() const;
+	};
+
+	constexpr xmldoc::nodeidx xmldoc::npos;
+	constexpr xmldoc::atom xmldoc::noAtom;
+
+#if defined(XMLITE_FILE_MAPPING)
+	/*
+	 * Read-only mapping of a whole file, pages are only read in as they're touched.
+	 * Access is hinted to be sequential, parsing goes through the file front to back
+	 */
+	class mappedfile
+	{
+	private:
+		const char * m_data{ "" };
+		std::size_t m_size{ 0 };
+	#if defined(_WIN32)
+		HANDLE m_mapping{ nullptr };
+	#endif
+
+		inline void release() noexcept;
+
+	public:
+		mappedfile() noexcept = default;
+		explicit inline mappedfile(const char * path);
+		explicit mappedfile(const std::string & path)
+			: mappedfile(path.c_str())
+		{
+		}
+		mappedfile(const mappedfile &) = delete;
+		mappedfile(mappedfile && other) noexcept
+		{
+			*this = std::move(other);
+		}
+		mappedfile & operator=(const mappedfile &) = delete;
+		mappedfile & operator=(mappedfile && other) noexcept
+		{
+			if (this != &other)
+			{
+				this->release();
+				this->m_data = other.m_data;
+				this->m_size = other.m_size;
+				other.m_data = "";
+				other.m_size = 0;
+			#if defined(_WIN32)
+				this->m_mapping  = other.m_mapping;
+				other.m_mapping  = nullptr;
+			#endif
+			}
+			return *this;
+		}
+		~mappedfile() noexcept
+		{
+			this->release();
+		}
+
+		// Not null-terminated, an empty file gives an empty string
+		const char * data() const noexcept
+		{
+			return this->m_data;
+		}
+		std::size_t size() const noexcept
+		{
+			return this->m_size;
+		}
+	};
+#endif
+
+	class xml
+	{
+	public:
+		enum class version : std::uint8_t
+		{
+			v1_0,
+			v1_1,
+
+			enum_size
+		};
+		static constexpr const char * versionStr[underlying_cast(version::enum_size)]
+		{
+			"1.0",
+			"1.1"
+		};
+
+		enum class BOMencoding : std::uint8_t
+		{
+			UTF_32LE,
+			UTF_32BE,
+			UTF_8,
+			UTF_7,
+			UTF_1,
+			UTF_16LE,
+			UTF_16BE,
+
+			enum_size
+		};
+		static constexpr const std::uint8_t BOMLength[]
+		{
+			4,
+			4,
+			3,
+			3,
+			3,
+			2,
+			2
+		};
+		static constexpr const char * BOMStrings[]
+		{
+			"UTF-32LE",
+			"UTF-32BE",
+			"UTF-8",
+			"UTF-7",
+			"UTF-1",
+			"UTF-16LE",
+			"UTF-16BE"
+		};
+	
+	private:
+		friend class xmlnode;
+		friend class xmldoc;
+		template<typename Handler>
+		friend void parse(const char * xmlFile, std::size_t length, Handler & handler, const parseOptions & options);
+		friend void check(const char * xmlFile, std::size_t length, const parseOptions & options);
+		friend class batchparser;
+
+		static constexpr const char * defEnc{ "UTF-8" };
+
+		version m_ver{ version::v1_0 };
+		std::string m_encoding{ defEnc };
+		bool m_standalone{};
+		bool m_verInit, m_encInit, m_saInit;
+
+		xmldoc m_doc;
+		// With arena storage the tree is only built from m_doc when it's asked for
+		mutable xmlnode m_nodes;
+		mutable bool m_nodesInit{ true };
+
+		xmlnode & nodes() const
+		{
+			if (!this->m_nodesInit)
+			{
+				this->m_nodes     = this->m_doc.toNode();
+				this->m_nodesInit = true;
+			}
+			return this->m_nodes;
+		}
+
+		static inline void innerCheck(const char * xml, std::size_t len);
+		// Offsets in the exception count from xmlFile, so they include a skipped BOM
+		static inline void checkUTF8(const char * xmlFile, const char * start, std::size_t length);
+
+	public:
+
+		xml(const char * xmlFile, std::size_t length, const parseOptions & options)
+		{
+			length = strlen(xmlFile, length);
+			std::string file;
+
+			const char * start = xmlFile;
+			auto bom = getBOM(xmlFile, length);
+			if (bom == underlying_cast(BOMencoding::UTF_8))
+			{
+				start  += BOMLength[bom];
+				length -= BOMLength[bom];
+			}
+			else if (bom != -1)
+			{
+				file   = convertDOM(xmlFile, length);
+				start  = file.c_str();
+				length = file.length();
+			}
+			if (options.validateUTF8 && (bom == -1 || bom == underlying_cast(BOMencoding::UTF_8)))
+			{
+				checkUTF8(xmlFile, start, length);
+			}
+
+			auto decl = parseProlog(start, length);
+			if (bom != -1)
+			{
+				decl.encoding = BOMStrings[bom];
+				decl.encInit  = true;
+			}
+
+			this->m_ver        = decl.ver;
+			this->m_verInit    = decl.verInit;
+			this->m_encoding   = std::move(decl.encoding);
+			this->m_encInit    = decl.encInit;
+			this->m_standalone = decl.standalone;
+			this->m_saInit     = decl.saInit;
+
+			if (options.storage == docStorage::Nodes)
+			{
+				auto nodeOptions = options;
+				nodeOptions.validateUTF8 = false;
+				this->m_nodes = { start, length, nodeOptions };
+			}
+			else
+			{
+				const bool views = options.storage == docStorage::View;
+				if (views && start == file.c_str())
+				{
+					// The converted buffer has to live as long as the document
+					auto buf = std::make_shared<const std::string>(std::move(file));
+					start = buf->c_str();
+					this->m_doc.m_source = std::move(buf);
+				}
+				this->m_doc.build(start, length, options);
+				this->m_nodesInit = false;
+			}
+		}
+		xml(const char * xmlFile, std::size_t length)
+			: xml(xmlFile, length, parseOptions())
+		{
+		}
+		xml(const char * xmlFile)
+			: xml(xmlFile, std::char_traits<char>::length(xmlFile))
+		{
+		}
+		xml(const std::string & xmlFile)
+			: xml(xmlFile.c_str(), xmlFile.length())
+		{
+		}
+		xml(const std::string & xmlFile, const parseOptions & options)
+			: xml(xmlFile.c_str(), xmlFile.length(), options)
+		{
+		}
+
+		/*
+		 * Parses a file, with XMLITE_FILE_MAPPING straight from a memory mapping instead of reading it into
+		 * a string first. With view storage the document keeps the file's contents alive & refers to them,
+		 * unless they had to be converted
+		 */
+		static inline xml fromFile(const char * path, const parseOptions & options = parseOptions());
+		static xml fromFile(const std::string & path, const parseOptions & options = parseOptions())
+		{
+			return fromFile(path.c_str(), options);
+		}
+		xml(const xml & other) = default;
+		xml(xml && other) noexcept = default;
+		xml & operator=(const xml & other) = default;
+		xml & operator=(xml && other) noexcept = default;
+
+		operator xmlnode &()
+		{
+			return this->nodes();
+		}
+		operator const xmlnode &() const
+		{
+			return this->nodes();
+		}
+		xmlnode & get()
+		{
+			return this->nodes();
+		}
+		// Empty unless the document was parsed with arena or view storage
+		const xmldoc & doc() const noexcept
+		{
+			return this->m_doc;
+		}
+
+		std::string getVersion() const
+		{
+			return versionStr[underlying_cast(this->m_ver)];
+		}
+		std::string getEncoding() const
+		{
+			return this->m_encoding;
+		}
+		std::string getStandalone() const
+		{
+			return this->m_standalone ? "yes" : "no";
+		}
+
+		// Contents of the XML declaration, e.g <?xml version="1.0" encoding="UTF-8" standalone="no"?>
+		struct prolog
+		{
+			version ver{ version::v1_0 };
+			std::string encoding{ defEnc };
+			bool standalone{ false };
+			bool verInit{ false }, encInit{ false }, saInit{ false };
+		};
+
+		static inline prolog parseProlog(const char * xmlFile, std::size_t length);
+		static inline version getVersion(const char * xmlFile, std::size_t length, bool & init);
+		static inline std::string getEncoding(const char * xmlFile, std::size_t length, bool & init);
+		static inline bool getStandalone(const char * xmlFile, std::size_t length, bool & init);
+		static inline std::int8_t getBOM(const char * xmlFile, std::size_t length);
+
+		std::string dumpHeader() const
+		{
+			std::string str = "<?xml";
+
+			str += " version=\"";
+			str += versionStr[underlying_cast(this->m_ver)];
+			str += '"';
+
+			if (this->m_saInit)
+			{
+				str += " standalone=";
+				str += this->m_standalone ? "\"yes\"" : "\"no\"";
+			}
+
+			str += "?>";
+			return str;
+		}
+
+		std::string dump(const dumpOptions & options) const
+		{
+			std::string str = this->dumpHeader();
+			if (options.style == dumpStyle::Pretty)
+			{
+				str += '\n';
+			}
+			this->nodes().dump(str, options);
+			return str;
+		}
+		std::string dump() const
+		{
+			return this->dump(dumpOptions());
+		}
+
+	};
+
+	constexpr const char * xml::versionStr[];
+	constexpr const std::uint8_t xml::BOMLength[];
+	constexpr const char * xml::BOMStrings[];
+
+	/*
+	 * Converts BOM-marked input to UTF-8 piece by piece, so a big file can be read in chunks
+	 * of any size; only partial code units are carried between the pieces.
+	 * UTF-7 & UTF-1 input is collected and converted as a whole by finish()
+	 */
+	class transcoder
+	{
+	private:
+		std::string m_pending;
+		std::int8_t m_bom{ -1 };
+		bool m_detected{ false };
+
+		template<std::size_t Size, bool BigEndian>
+		static inline const char * decode(const char * it, const char * end, std::string & out, bool final);
+		inline const char * decode(const char * it, const char * end, std::string & out, bool final) const;
+		inline bool buffered() const noexcept;
+
+	public:
+		// Appends the UTF-8 form of the next piece of input to out
+		inline void feed(const char * data, std::size_t length, std::string & out);
+		// Flushes whatever is still carried, the transcoder can be reused afterwards
+		inline void finish(std::string & out);
+
+		// Index to xml::BOMencoding, -1 if there was no BOM or it hasn't been seen yet
+		std::int8_t encoding() const noexcept
+		{
+			return this->m_bom;
+		}
+	};
+
+	/*
+	 * Writes XML straight to an output without building a tree, values are escaped on the way.
+	 * Output goes through a fixed-size buffer, apart from that memory only grows with the nesting depth.
+	 * Tags have to be balanced & there may only be one root element, anything else throws
+	 */
+	class writer
+	{
+	public:
+		using callback = std::function<void(const char * data, std::size_t length)>;
+		static constexpr std::size_t defBufSize{ 64 * 1024 };
+
+	private:
+		inner::outbuffer m_out;
+		dumpStyle m_style;
+
+		// Names of the open elements one after another, innermost last
+		std::string m_names;
+		std::vector<std::size_t> m_nameStarts;
+		// The start tag of the innermost element isn't closed yet, attributes can still be added
+		bool m_inStartTag{ false };
+		bool m_written{ false }, m_rootDone{ false };
+
+		inline void beginNode();
+		inline void closeStartTag();
+		inline void value(const char * str, std::size_t len);
+
+	public:
+		writer(callback flush, dumpStyle style = dumpStyle::Pretty, std::size_t bufSize = defBufSize)
+			: m_out(std::move(flush), bufSize), m_style(style)
+		{
+		}
+		template<typename Traits>
+		writer(std::basic_ostream<char, Traits> & os, dumpStyle style = dumpStyle::Pretty, std::size_t bufSize = defBufSize)
+			: writer([&os](const char * data, std::size_t length)
+				{
+					if (!os.write(data, std::streamsize(length)))
+					{
+						throw exception(exception::Type::WriteFailed);
+					}
+				}, style, bufSize)
+		{
+		}
+		// The descriptor isn't closed by the writer
+		writer(int fd, dumpStyle style = dumpStyle::Pretty, std::size_t bufSize = defBufSize)
+			: writer([fd](const char * data, std::size_t length)
+				{
+					if (!inner::writeAll(fd, data, length))
+					{
+						throw exception(exception::Type::WriteFailed);
+					}
+				}, style, bufSize)
+		{
+		}
+		writer(const writer & other) = delete;
+		writer(writer && other) = default;
+		writer & operator=(const writer & other) = delete;
+		writer & operator=(writer && other) = default;
+		// Whatever is still buffered gets written, errors are ignored at this point
+		~writer() noexcept
+		{
+			try
+			{
+				this->m_out.flush();
+			}
+			catch (...)
+			{
+			}
+		}
+
+		// Only allowed before anything else
+		inline writer & declaration(xml::version ver = xml::version::v1_0);
+		inline writer & start(strview name);
+		// Only allowed right after start()
+		inline writer & attr(strview name, strview value);
+		template<typename T>
+		typename std::enable_if<std::is_arithmetic<T>::value && !std::is_same<T, char>::value, writer &>::type attr(strview name, T value)
+		{
+			char buf[32];
+			return this->attr(name, strview(buf, inner::formatNumber(buf, value)));
+		}
+		inline writer & text(strview value);
+		template<typename T>
+		typename std::enable_if<std::is_arithmetic<T>::value && !std::is_same<T, char>::value, writer &>::type text(T value)
+		{
+			char buf[32];
+			return this->text(strview(buf, inner::formatNumber(buf, value)));
+		}
+		inline writer & comment(strview value);
+		// Closes the innermost open element, elements without content become self-closing tags
+		inline writer & end();
+		// Same, but checks that the innermost open element has this name
+		inline writer & end(strview name);
+
+		// Hands everything written so far to the output
+		void flush()
+		{
+			this->m_out.flush();
+		}
+		// Checks that the document is complete & flushes it
+		inline void finish();
+
+		std::size_t depth() const noexcept
+		{
+			return this->m_nameStarts.size();
+		}
+	};
+
+	constexpr std::size_t writer::defBufSize;
+
+	namespace inner
+	{
+		// Turns tokenizer events into views for a streaming handler, keeps track of the root element
+		template<typename Handler>
+		struct saxadapter
+		{
+			Handler & handler;
+			bool decode;
+			std::size_t depth{ 0 };
+			bool rootDone{ false };
+
+			std::string buf;
+			std::vector<attrview> attrs;
+
+			saxadapter(Handler & h, bool dec) noexcept
+				: handler(h), decode(dec)
+			{
+			}
+
+			void startElement(const char * name, std::size_t nameLen, const attrview * a, std::size_t numAttrs)
+			{
+				if (this->depth == 0 && this->rootDone)
+				{
+					return;
+				}
+				++this->depth;
+
+				std::size_t total = 0;
+				bool refs = false;
+				for (std::size_t i = 0; this->decode && i < numAttrs; ++i)
+				{
+					total += a[i].value.size();
+					refs  |= std::memchr(a[i].value.data(), '&', a[i].value.size()) != nullptr;
+				}
+				if (refs)
+				{
+					// Decoded values share one buffer that's sized up front, so none of the views move
+					this->buf.resize(total);
+					this->attrs.assign(a, a + numAttrs);
+					char * out = &this->buf[0];
+					for (auto & attr : this->attrs)
+					{
+						char * valueEnd = inner::decodeEntities(out, attr.value.begin(), attr.value.end());
+						attr.value = strview(out, std::size_t(valueEnd - out));
+						out = valueEnd;
+					}
+					a = this->attrs.data();
+				}
+				this->handler.startElement(strview(name, nameLen), a, numAttrs);
+			}
+			void endElement(const char * name, std::size_t nameLen)
+			{
+				if (this->depth == 0)
+				{
+					return;
+				}
+				--this->depth;
+				this->rootDone = this->depth == 0;
+				this->handler.endElement(strview(name, nameLen));
+			}
+			void text(const char * str, std::size_t strLen)
+			{
+				if (this->depth == 0)
+				{
+					return;
+				}
+				this->handler.text(this->decode ? decodeEntities(strview(str, strLen), this->buf) : strview(str, strLen));
+			}
+			// Character data of a CDATA section has no references
+			void cdata(const char * str, std::size_t strLen)
+			{
+				if (this->depth == 0)
+				{
+					return;
+				}
+				this->handler.text(strview(str, strLen));
+			}
+			void comment(const char * str, std::size_t strLen)
+			{
+				this->handler.comment(strview(str, strLen));
+			}
+		};
+
+		/*
+		 * Runs the tokenizer over a document that arrives in pieces. Complete markup is tokenized
+		 * straight from the piece, only a construct cut by its end is carried over to the next one
+		 */
+		template<typename Handler>
+		class feeder
+		{
+		private:
+			tokenizer<Handler> m_tok;
+			bool m_validateUTF8;
+
+			// Unconsumed tail of the previous pieces
+			std::string m_carry;
+			// First bytes until the BOM is known, other encodings are converted to UTF-8 on the way
+			std::string m_head, m_utf8;
+			transcoder m_conv;
+			bool m_detected{ false }, m_convert{ false };
+			// UTF-8 sequence cut by the end of a piece, input offset of the next byte to check
+			std::string m_seq;
+			std::size_t m_offset{ 0 };
+
+			inline void begin(bool final);
+			inline void pass(const char * it, const char * end, bool final);
+			inline void checkUTF8(const char * it, const char * end, bool final);
+			inline void consume(const char * it, const char * end, bool final);
+			inline bool runCarry(bool final);
+
+		public:
+			feeder(Handler & handler, bool validate, bool validateUTF8) noexcept
+				: m_tok(handler, validate), m_validateUTF8(validateUTF8)
+			{
+			}
+
+			inline void feed(const char * data, std::size_t length);
+			inline void finish();
+		};
+	}
+
+	struct xmlnode::builder
+	{
+		xmlnode root;
+		// Currently open elements, innermost last
+		std::vector<xmlnode *> stack;
+		bool rootDone{ false };
+
+		std::string valueStr, cdataStr;
+		bool prevWhiteSpace{ false };
+		bool decode;
+
+		explicit builder(bool d) noexcept
+			: decode(d)
+		{
+		}
+
+		// Hands over the tree, the buffers stay for the next document
+		xmlnode take() noexcept
+		{
+			xmlnode node = std::move(this->root);
+			this->root = xmlnode();
+			this->stack.clear();
+			this->rootDone = false;
+			this->valueStr.clear();
+			this->prevWhiteSpace = false;
+			return node;
+		}
+
+		void flushText()
+		{
+			if (!this->valueStr.empty())
+			{
+				// References are resolved after collapsing, like escapeChars on a stored value
+				if (this->decode)
+				{
+					inner::decodeEntities(this->valueStr);
+				}
+				this->stack.back()->add(this->valueStr);
+				this->stack.back()->m_values.back().m_escaped = !this->decode;
+				this->valueStr.clear();
+			}
+			this->prevWhiteSpace = false;
+		}
+
+		void startElement(const char * name, std::size_t nameLen, const attrview * attrs, std::size_t numAttrs)
+		{
+			xmlnode * node;
+			if (this->stack.empty())
+			{
+				if (this->rootDone)
+				{
+					return;
+				}
+				node = &this->root;
+				node->m_tag.assign(name, nameLen);
+			}
+			else
+			{
+				this->flushText();
+
+				node = &this->stack.back()->emplace(std::string(name, nameLen));
+			}
+
+			node->m_escaped = !this->decode;
+			for (std::size_t i = 0; i < numAttrs; ++i)
+			{
+				std::string value = attrs[i].value.str();
+				if (this->decode)
+				{
+					inner::decodeEntities(value);
+				}
+				node->elem().attributes.emplace(attrs[i].name.str(), std::move(value));
+			}
+			this->stack.push_back(node);
+		}
+		void endElement(const char *, std::size_t)
+		{
+			if (this->stack.empty())
+			{
+				return;
+			}
+			this->flushText();
+			this->stack.pop_back();
+			this->rootDone = this->stack.empty();
+		}
+		void text(const char * str, std::size_t strLen)
+		{
+			if (this->stack.empty())
+			{
+				return;
+			}
+
+			// Whitespace is collapsed, trailing whitespace is dropped
+			inner::collapseWhiteSpace(this->valueStr, str, strLen, this->prevWhiteSpace);
+		}
+		// CDATA joins the surrounding text in escaped form, so that the whole value is in one form
+		void cdata(const char * str, std::size_t strLen)
+		{
+			if (this->stack.empty())
+			{
+				return;
+			}
+
+			const std::size_t start = this->valueStr.size();
+			inner::collapseWhiteSpace(this->valueStr, str, strLen, this->prevWhiteSpace);
+			const char * end = this->valueStr.data() + this->valueStr.size();
+			if (inner::findAny(this->valueStr.data() + start, end, '<', '&', '>') != end)
+			{
+				this->cdataStr.assign(this->valueStr, start, std::string::npos);
+				this->valueStr.resize(start);
+				inner::stringwriter out{ this->valueStr };
+				inner::escape(out, this->cdataStr.data(), this->cdataStr.data() + this->cdataStr.size());
+			}
+		}
+		void comment(const char *, std::size_t)
+		{
+		}
+	};
+
+
+	/*
+	 * Parses a document that arrives in pieces, e.g from a socket, without joining them first.
+	 * The handler gets the same events as with xmlite::parse as soon as the markup is complete,
+	 * views refer to the fed piece or to the carried tail of the previous ones
+	 */
+	template<typename Handler>
+	class pushparser
+	{
+	private:
+		inner::saxadapter<Handler> m_adapter;
+		inner::feeder<inner::saxadapter<Handler>> m_feeder;
+
+	public:
+		explicit pushparser(Handler & handler, const parseOptions & options = parseOptions())
+			: m_adapter(handler, options.decodeEntities), m_feeder(m_adapter, !options.trusted, options.validateUTF8)
+		{
+		}
+		pushparser(const pushparser &) = delete;
+		pushparser & operator=(const pushparser &) = delete;
+
+		void feed(const char * data, std::size_t length)
+		{
+			this->m_feeder.feed(data, length);
+		}
+		void feed(const std::string & data)
+		{
+			this->m_feeder.feed(data.c_str(), data.length());
+		}
+		// Ends the document, throws if it isn't complete
+		void finish()
+		{
+			this->m_feeder.finish();
+		}
+	};
+
+	/*
+	 * Builds an xmlnode tree from a document that arrives in pieces, always with the single-pass parser.
+	 * Like the xmlnode constructor, the prolog isn't kept
+	 */
+	class nodeparser
+	{
+	private:
+		xmlnode::builder m_builder;
+		inner::feeder<xmlnode::builder> m_feeder;
+
+	public:
+		explicit nodeparser(const parseOptions & options = parseOptions())
+			: m_builder(options.decodeEntities), m_feeder(m_builder, !options.trusted, options.validateUTF8)
+		{
+		}
+		nodeparser(const nodeparser &) = delete;
+		nodeparser & operator=(const nodeparser &) = delete;
+
+		void feed(const char * data, std::size_t length)
+		{
+			this->m_feeder.feed(data, length);
+		}
+		void feed(const std::string & data)
+		{
+			this->m_feeder.feed(data.c_str(), data.length());
+		}
+		// Ends the document & hands over the tree, throws if it isn't complete
+		xmlnode finish()
+		{
+			this->m_feeder.finish();
+			return std::move(this->m_builder.root);
+		}
+	};
+
+	/*
+	 * Parses batches of documents into xmlnode trees on a fixed set of threads, with the single-pass parser.
+	 * Every worker keeps its tokenizer, tag stack & text buffers between documents, so after warming up
+	 * only the trees themselves are allocated. Keep one around instead of making one per batch
+	 */
+	class batchparser
+	{
+	public:
+		struct result
+		{
+			xmlnode node;
+			// Set instead of node if the document couldn't be parsed
+			std::exception_ptr error;
+		};
+
+	private:
+		parseOptions m_options;
+		std::vector<std::thread> m_workers;
+
+		// Batches are handed over one at a time
+		std::mutex m_batchMutex;
+		std::mutex m_mutex;
+		std::condition_variable m_wake, m_done;
+		const strview * m_docs{ nullptr };
+		result * m_results{ nullptr };
+		std::size_t m_count{ 0 };
+		std::atomic<std::size_t> m_next{ 0 };
+		std::size_t m_busy{ 0 };
+		std::uint64_t m_batch{ 0 };
+		bool m_stop{ false };
+
+		inline void work();
+		inline void stop() noexcept;
+
+	public:
+		// Threads are started right away, 0 means one per core
+		explicit inline batchparser(std::size_t threads = 0, const parseOptions & options = parseOptions());
+		batchparser(const batchparser &) = delete;
+		batchparser & operator=(const batchparser &) = delete;
+		~batchparser() noexcept
+		{
+			this->stop();
+		}
+
+		// Results are in the same order as the documents
+		inline std::vector<result> parse(const strview * docs, std::size_t count);
+		std::vector<result> parse(const std::vector<strview> & docs)
+		{
+			return this->parse(docs.data(), docs.size());
+		}
+
+		std::size_t threads() const noexcept
+		{
+			return this->m_workers.size();
+		}
+	};
+
+	// One-off batch on a temporary pool, a batchparser can be reused between batches
+	inline std::vector<batchparser::result> parseBatch(const strview * docs, std::size_t count, const parseOptions & options = parseOptions())
+	{
+		batchparser pool(0, options);
+		return pool.parse(docs, count);
+	}
+	inline std::vector<batchparser::result> parseBatch(const std::vector<strview> & docs, const parseOptions & options = parseOptions())
+	{
+		return parseBatch(docs.data(), docs.size(), options);
+	}
+}
+
+
+inline void * xmlite::arena::allocate(std::size_t size, std::size_t align)
+{
+	auto padding = [](const char * ptr, std::size_t align)
+	{
+		return (align - std::size_t(reinterpret_cast<std::uintptr_t>(ptr) % align)) % align;
+	};
+
+	std::size_t pad = padding(this->m_cur, align);
+	if (this->m_cur == nullptr || (pad + size) > this->m_left)
+	{
+		// Blocks grow geometrically, oversized requests get a block of their own size
+		const std::size_t blockSize = size + align > this->m_blockSize ? size + align : this->m_blockSize;
+		this->m_blocks.push_back({ std::unique_ptr<char[]>(new char[blockSize]), blockSize });
+		this->m_cur  = this->m_blocks.back().mem.get();
+		this->m_left = blockSize;
+		this->m_blockSize = this->m_blockSize * 2 > maxBlockSize ? maxBlockSize : this->m_blockSize * 2;
+		if (this->m_blockSize < blockSize && blockSize <= maxBlockSize)
+		{
+			this->m_blockSize = blockSize;
+		}
+		pad = padding(this->m_cur, align);
+	}
+
+	void * mem = this->m_cur + pad;
+	this->m_cur  += pad + size;
+	this->m_left -= pad + size;
+	return mem;
+}
+
+inline std::string xmlite::convertDOM(const char * bomStr, std::size_t length)
+{
+	length = strlen(bomStr, length);
+
+	auto bom = xml::getBOM(bomStr, length);
+	if (bom == -1)
+	{
+		return { bomStr, length };
+	}
+	const char * start = bomStr + xml::BOMLength[bom], * end = bomStr + length;
+
+	// UTF-16 & UTF-32 are decoded straight from the input in either byte order
+	switch (static_cast<xml::BOMencoding>(bom))
+	{
+	case xml::BOMencoding::UTF_1:
+		return xmlite::UTF1toUTF8(start, std::size_t(end - start));
+	case xml::BOMencoding::UTF_7:
+		return xmlite::UTF7toUTF8(start, std::size_t(end - start));
+	case xml::BOMencoding::UTF_8:
+		return { start, std::size_t(end - start) };
+	case xml::BOMencoding::UTF_16LE:
+		return inner::transcode<2, false>(start, end);
+	case xml::BOMencoding::UTF_16BE:
+		return inner::transcode<2, true>(start, end);
+	case xml::BOMencoding::UTF_32LE:
+		return inner::transcode<4, false>(start, end);
+	case xml::BOMencoding::UTF_32BE:
+		return inner::transcode<4, true>(start, end);
+	default:
+		return { bomStr, length };
+	}
+}
+inline std::size_t xmlite::validateUTF8(const char * str, std::size_t length) noexcept
+{
+	length = strlen(str, length);
+	return std::size_t(inner::findInvalidUTF8(str, str + length) - str);
+}
+template<std::size_t Size, bool BigEndian>
+inline const char * xmlite::transcoder::decode(const char * it, const char * end, std::string & out, bool final)
+{
+	const std::size_t len = std::size_t(end - it), old = out.size();
+	out.resize(old + len + len / 2 + 16);
+	inner::utf8writer writer{ &out[old] };
+	it = inner::decodeUTF<Size, BigEndian>(it, end, writer, final);
+	out.resize(std::size_t(writer.out - out.data()));
+	return it;
+}
+inline const char * xmlite::transcoder::decode(const char * it, const char * end, std::string & out, bool final) const
+{
+	switch (static_cast<xml::BOMencoding>(this->m_bom))
+	{
+	case xml::BOMencoding::UTF_16LE:
+		return decode<2, false>(it, end, out, final);
+	case xml::BOMencoding::UTF_16BE:
+		return decode<2, true>(it, end, out, final);
+	case xml::BOMencoding::UTF_32LE:
+		return decode<4, false>(it, end, out, final);
+	case xml::BOMencoding::UTF_32BE:
+		return decode<4, true>(it, end, out, final);
+	default:
+		out.append(it, std::size_t(end - it));
+		return end;
+	}
+}
+inline bool xmlite::transcoder::buffered() const noexcept
+{
+	return this->m_bom == underlying_cast(xml::BOMencoding::UTF_7) || this->m_bom == underlying_cast(xml::BOMencoding::UTF_1);
+}
+inline void xmlite::transcoder::feed(const char * data, std::size_t length, std::string & out)
+{
+	const char * it = data, * end = data + length;
+	if (!this->m_detected)
+	{
+		// The longest BOM is 4 bytes
+		const std::size_t need = 4 - this->m_pending.size() < length ? 4 - this->m_pending.size() : length;
+		this->m_pending.append(it, need);
+		it += need;
+		if (this->m_pending.size() < 4)
+		{
+			return;
+		}
+		this->m_bom = xml::getBOM(this->m_pending.c_str(), this->m_pending.size());
+		this->m_detected = true;
+		if (this->m_bom != -1)
+		{
+			this->m_pending.erase(0, xml::BOMLength[this->m_bom]);
+		}
+	}
+
+	if (this->buffered())
+	{
+		this->m_pending.append(it, std::size_t(end - it));
+		return;
+	}
+
+	if (!this->m_pending.empty())
+	{
+		// Complete the carried code unit (& a surrogate pair) with the first few bytes
+		const std::size_t carried = this->m_pending.size(), take = std::size_t(end - it) < 8 ? std::size_t(end - it) : 8;
+		this->m_pending.append(it, take);
+		const std::size_t used = std::size_t(this->decode(this->m_pending.data(), this->m_pending.data() + this->m_pending.size(), out, false) - this->m_pending.data());
+		if (used < carried)
+		{
+			// Everything is still pending
+			this->m_pending.erase(0, used);
+			return;
+		}
+		it += used - carried;
+		this->m_pending.clear();
+	}
+
+	it = this->decode(it, end, out, false);
+	this->m_pending.assign(it, std::size_t(end - it));
+}
+inline void xmlite::transcoder::finish(std::string & out)
+{
+	if (!this->m_detected)
+	{
+		this->m_bom = xml::getBOM(this->m_pending.c_str(), this->m_pending.size());
+		if (this->m_bom != -1)
+		{
+			this->m_pending.erase(0, xml::BOMLength[this->m_bom]);
+		}
+	}
+
+	if (this->m_bom == underlying_cast(xml::BOMencoding::UTF_7))
+	{
+		out += xmlite::UTF7toUTF8(this->m_pending.c_str(), this->m_pending.size());
+	}
+	else if (this->m_bom == underlying_cast(xml::BOMencoding::UTF_1))
+	{
+		out += xmlite::UTF1toUTF8(this->m_pending.c_str(), this->m_pending.size());
+	}
+	else
+	{
+		this->decode(this->m_pending.data(), this->m_pending.data() + this->m_pending.size(), out, true);
+	}
+
+	this->m_pending.clear();
+	this->m_pending.shrink_to_fit();
+	this->m_bom = -1;
+	this->m_detected = false;
+}
+
+template<typename Handler>
+inline void xmlite::parse(const char * xmlFile, std::size_t length, Handler & handler, const parseOptions & options)
+{
+	length = strlen(xmlFile, length);
+
+	std::string file;
+	const char * start = xmlFile;
+	auto bom = xml::getBOM(xmlFile, length);
+	if (bom == underlying_cast(xml::BOMencoding::UTF_8))
+	{
+		start  += xml::BOMLength[bom];
+		length -= xml::BOMLength[bom];
+	}
+	else if (bom != -1)
+	{
+		file   = convertDOM(xmlFile, length);
+		start  = file.c_str();
+		length = file.length();
+	}
+	if (options.validateUTF8 && (bom == -1 || bom == underlying_cast(xml::BOMencoding::UTF_8)))
+	{
+		xml::checkUTF8(xmlFile, start, length);
+	}
+
+	inner::saxadapter<Handler> adapter(handler, options.decodeEntities);
+	inner::tokenizer<inner::saxadapter<Handler>> tok(adapter, !options.trusted);
+	tok.run(start, start + length);
+}
+
+template<typename Handler>
+inline void xmlite::inner::feeder<Handler>::feed(const char * data, std::size_t length)
+{
+	const char * it = data, * end = data + length;
+	if (!this->m_detected)
+	{
+		// The longest BOM is 4 bytes
+		const std::size_t need = 4 - this->m_head.size() < length ? 4 - this->m_head.size() : length;
+		this->m_head.append(it, need);
+		it += need;
+		if (this->m_head.size() < 4)
+		{
+			return;
+		}
+		this->begin(false);
+	}
+	this->pass(it, end, false);
+}
+template<typename Handler>
+inline void xmlite::inner::feeder<Handler>::finish()
+{
+	if (!this->m_detected)
+	{
+		this->begin(true);
+	}
+	else
+	{
+		this->pass(this->m_carry.data(), this->m_carry.data(), true);
+	}
+}
+template<typename Handler>
+inline void xmlite::inner::feeder<Handler>::begin(bool final)
+{
+	const auto bom = xml::getBOM(this->m_head.c_str(), this->m_head.size());
+	this->m_detected = true;
+	this->m_convert  = bom != -1 && bom != underlying_cast(xml::BOMencoding::UTF_8);
+
+	// The transcoder looks for the BOM itself, UTF-8 skips it
+	const std::size_t skip = bom == -1 || this->m_convert ? 0 : xml::BOMLength[bom];
+	this->m_offset = skip;
+	this->pass(this->m_head.data() + skip, this->m_head.data() + this->m_head.size(), final);
+}
+template<typename Handler>
+inline void xmlite::inner::feeder<Handler>::pass(const char * it, const char * end, bool final)
+{
+	if (this->m_convert)
+	{
+		this->m_conv.feed(it, std::size_t(end - it), this->m_utf8);
+		if (final)
+		{
+			this->m_conv.finish(this->m_utf8);
+		}
+		this->consume(this->m_utf8.data(), this->m_utf8.data() + this->m_utf8.size(), final);
+		this->m_utf8.clear();
+		return;
+	}
+
+	if (this->m_validateUTF8)
+	{
+		this->checkUTF8(it, end, final);
+	}
+	this->consume(it, end, final);
+}
+template<typename Handler>
+inline void xmlite::inner::feeder<Handler>::checkUTF8(const char * it, const char * end, bool final)
+{
+	auto seqLen = [](char lead) -> std::size_t
+	{
+		const auto c = static_cast<unsigned char>(lead);
+		return c < 0xC0 ? 1 : c < 0xE0 ? 2 : c < 0xF0 ? 3 : 4;
+	};
+
+	if (!this->m_seq.empty())
+	{
+		// Complete the sequence carried from the previous piece
+		const std::size_t need = seqLen(this->m_seq[0]) - this->m_seq.size();
+		const std::size_t take = need < std::size_t(end - it) ? need : std::size_t(end - it);
+		this->m_seq.append(it, take);
+		it += take;
+		if (take < need && !final)
+		{
+			return;
+		}
+		const char * seqEnd = this->m_seq.data() + this->m_seq.size();
+		if (findInvalidUTF8(this->m_seq.data(), seqEnd) != seqEnd)
+		{
+			throw exception(exception::Type::ParseInvalidUTF8, this->m_offset);
+		}
+		this->m_offset += this->m_seq.size();
+		this->m_seq.clear();
+	}
+
+	// A sequence cut by the end of the piece is checked once the rest of it is there
+	const char * cut = end;
+	for (std::size_t k = 1; !final && k <= 3 && k <= std::size_t(end - it); ++k)
+	{
+		const auto c = static_cast<unsigned char>(*(end - k));
+		if ((c & 0xC0) != 0x80)
+		{
+			if (c >= 0xC0 && seqLen(char(c)) > k)
+			{
+				cut = end - k;
+			}
+			break;
+		}
+	}
+
+	const char * bad = findInvalidUTF8(it, cut);
+	if (bad != cut)
+	{
+		throw exception(exception::Type::ParseInvalidUTF8, this->m_offset + std::size_t(bad - it));
+	}
+	this->m_offset += std::size_t(cut - it);
+	this->m_seq.assign(cut, std::size_t(end - cut));
+}
+template<typename Handler>
+inline bool xmlite::inner::feeder<Handler>::runCarry(bool final)
+{
+	const char * start = this->m_carry.data();
+	const char * rest = this->m_tok.run(start, start + this->m_carry.size(), final);
+	this->m_carry.erase(0, std::size_t(rest - start));
+	return this->m_carry.empty();
+}
+template<typename Handler>
+inline void xmlite::inner::feeder<Handler>::consume(const char * it, const char * end, bool final)
+{
+	if (!this->m_carry.empty())
+	{
+		// The carried construct most likely ends at the next '>', only that much is copied
+		const char * gt = findChar(it, end, '>');
+		const char * next = gt == end ? end : gt + 1;
+		this->m_carry.append(it, std::size_t(next - it));
+		it = next;
+		if (!this->runCarry(final && it == end))
+		{
+			if (it != end)
+			{
+				this->m_carry.append(it, std::size_t(end - it));
+				this->runCarry(final);
+			}
+			return;
+		}
+	}
+
+	const char * rest = this->m_tok.run(it, end, final);
+	this->m_carry.assign(rest, std::size_t(end - rest));
+}
+
+inline void xmlite::check(const char * xmlFile, std::size_t length, const parseOptions & options)
+{
+	length = strlen(xmlFile, length);
+
+	std::string file;
+	const char * start = xmlFile;
+	auto bom = xml::getBOM(xmlFile, length);
+	if (bom == underlying_cast(xml::BOMencoding::UTF_8))
+	{
+		start  += xml::BOMLength[bom];
+		length -= xml::BOMLength[bom];
+	}
+	else if (bom != -1)
+	{
+		file   = convertDOM(xmlFile, length);
+		start  = file.c_str();
+		length = file.length();
+	}
+	const char * end = start + length;
+	const bool checkUTF8 = options.validateUTF8 && (bom == -1 || bom == underlying_cast(xml::BOMencoding::UTF_8));
+
+	struct ignore
+	{
+		void startElement(const char *, std::size_t, const attrview *, std::size_t)
+		{
+		}
+		void endElement(const char *, std::size_t)
+		{
+		}
+		void text(const char *, std::size_t)
+		{
+		}
+		void cdata(const char *, std::size_t)
+		{
+		}
+		void comment(const char *, std::size_t)
+		{
+		}
+	};
+	ignore handler;
+
+	const std::size_t threads = options.threads != 0 ? options.threads : std::thread::hardware_concurrency();
+	if (threads <= 1 || length < inner::parallelMinSize)
+	{
+		if (checkUTF8)
+		{
+			xml::checkUTF8(xmlFile, start, length);
+		}
+		inner::tokenizer<ignore> tok(handler);
+		tok.run(start, end);
+		return;
+	}
+
+	// Chunks start at a '<' & are assumed to start outside of markup, the chunk before confirms it
+	const std::size_t numChunks = threads * 4;
+	std::vector<const char *> bounds{ start };
+	for (std::size_t i = 1; i < numChunks; ++i)
+	{
+		const char * lt = inner::findChar(start + length / numChunks * i, end, '<');
+		if (lt == end)
+		{
+			break;
+		}
+		else if (lt > bounds.back())
+		{
+			bounds.push_back(lt);
+		}
+	}
+	bounds.push_back(end);
+	const std::size_t n = bounds.size() - 1;
+
+	struct chunkresult
+	{
+		inner::chunkedges edges;
+		// Where the chunk stopped, the start of the next one unless it ended inside markup
+		const char * rest{ nullptr };
+		std::exception_ptr error;
+		std::size_t badUTF8{ exception::noOffset };
+	};
+	auto runChunk = [&](std::size_t i, const char * from)
+	{
+		chunkresult res;
+		try
+		{
+			// The '<' that starts the next chunk tells that text before it is complete
+			const bool last = i + 1 == n;
+			inner::tokenizer<ignore> tok(handler);
+			tok.chunked(&res.edges);
+			res.rest = tok.run(from, last ? end : bounds[i + 1] + 1, last);
+			tok.leaveOpen(res.edges);
+		}
+		catch (...)
+		{
+			res.error = std::current_exception();
+		}
+		return res;
+	};
+
+	std::vector<chunkresult> results(n);
+	std::atomic<std::size_t> next{ 0 };
+	auto work = [&]()
+	{
+		for (std::size_t i; (i = next++) < n;)
+		{
+			results[i] = runChunk(i, bounds[i]);
+			if (checkUTF8)
+			{
+				// Chunks split at '<', so no sequence spans two of them
+				const char * bad = inner::findInvalidUTF8(bounds[i], bounds[i + 1]);
+				if (bad != bounds[i + 1])
+				{
+					results[i].badUTF8 = std::size_t(bad - xmlFile);
+				}
+			}
+		}
+	};
+
+	std::vector<std::thread> workers;
+	const std::size_t numWorkers = threads < n ? threads : n;
+	try
+	{
+		for (std::size_t i = 1; i < numWorkers; ++i)
+		{
+			workers.emplace_back(work);
+		}
+	}
+	catch (...)
+	{
+		// Whoever was started does the rest
+	}
+	work();
+	for (auto & worker : workers)
+	{
+		worker.join();
+	}
+
+	// Invalid UTF-8 is reported before anything else, like in a single pass
+	for (const auto & res : results)
+	{
+		if (res.badUTF8 != exception::noOffset)
+		{
+			throw exception(exception::Type::ParseInvalidUTF8, res.badUTF8);
+		}
+	}
+
+	// Chunks are joined in document order, the first error is the one a single pass would have found
+	std::string names;
+	std::vector<std::size_t> starts;
+	bool header = false;
+	std::size_t roots = 0;
+	for (std::size_t i = 0; i < n; ++i)
+	{
+		const auto & res = results[i];
+		for (const auto & edge : res.edges.edges)
+		{
+			switch (edge.type)
+			{
+			case inner::chunkedges::kind::Header:
+				header = true;
+				break;
+			case inner::chunkedges::kind::Root:
+				if (!starts.empty())
+				{
+					break;
+				}
+				else if (!header)
+				{
+					throw exception(exception::Type::ParseIncorrectHeader);
+				}
+				else if (roots != 0)
+				{
+					throw exception(exception::Type::ParseTooManyRoots);
+				}
+				++roots;
+				break;
+			case inner::chunkedges::kind::Close:
+			{
+				if (starts.empty())
+				{
+					throw exception(exception::Type::ParseIncorrectTag);
+				}
+				const std::size_t top = starts.back(), topLen = names.size() - top;
+				if (topLen != edge.nameLen || std::memcmp(names.data() + top, res.edges.names.data() + edge.nameStart, topLen) != 0)
+				{
+					throw exception(exception::Type::ParseNoTerminatingTag, names.data() + top, topLen);
+				}
+				names.resize(top);
+				starts.pop_back();
+				break;
+			}
+			}
+		}
+		if (res.error != nullptr)
+		{
+			std::rethrow_exception(res.error);
+		}
+
+		for (auto openStart : res.edges.openStarts)
+		{
+			starts.push_back(names.size() + openStart);
+		}
+		names += res.edges.openNames;
+
+		if (res.rest != bounds[i + 1])
+		{
+			// The next chunk started inside markup, it's checked again from where this one stopped
+			results[i + 1] = runChunk(i + 1, res.rest);
+		}
+	}
+
+	if (!header)
+	{
+		throw exception(exception::Type::ParseIncorrectHeader);
+	}
+	else if (!starts.empty())
+	{
+		throw exception(exception::Type::ParseNoTerminatingTag, names.data() + starts.back(), names.size() - starts.back());
+	}
+	else if (roots == 0)
+	{
+		throw exception(exception::Type::ParseNoRoot);
+	}
+}
+
+inline xmlite::batchparser::batchparser(std::size_t threads, const parseOptions & options)
+	: m_options(options)
+{
+	if (threads == 0)
+	{
+		threads = std::thread::hardware_concurrency() != 0 ? std::thread::hardware_concurrency() : 1;
+	}
+	try
+	{
+		for (std::size_t i = 0; i < threads; ++i)
+		{
+			this->m_workers.emplace_back(&batchparser::work, this);
+		}
+	}
+	catch (...)
+	{
+		this->stop();
+		throw;
+	}
+}
+inline void xmlite::batchparser::stop() noexcept
+{
+	{
+		std::lock_guard<std::mutex> lock(this->m_mutex);
+		this->m_stop = true;
+	}
+	this->m_wake.notify_all();
+	for (auto & worker : this->m_workers)
+	{
+		if (worker.joinable())
+		{
+			worker.join();
+		}
+	}
+	this->m_workers.clear();
+}
+inline void xmlite::batchparser::work()
+{
+	// Scratch state of this worker, reused for every document it gets
+	xmlnode::builder builder(this->m_options.decodeEntities);
+	inner::tokenizer<xmlnode::builder> tok(builder, !this->m_options.trusted);
+	std::string converted;
+
+	auto parseOne = [&](strview doc)
+	{
+		const char * xmlFile = doc.data(), * start = xmlFile;
+		std::size_t length = doc.size();
+
+		// A length of 0 would mean a null-terminated string to getBOM
+		auto bom = length != 0 ? xml::getBOM(xmlFile, length) : std::int8_t(-1);
+		if (bom == underlying_cast(xml::BOMencoding::UTF_8))
+		{
+			start  += xml::BOMLength[bom];
+			length -= xml::BOMLength[bom];
+		}
+		else if (bom != -1)
+		{
+			converted = convertDOM(xmlFile, length);
+			start  = converted.c_str();
+			length = converted.length();
+		}
+		if (this->m_options.validateUTF8 && (bom == -1 || bom == underlying_cast(xml::BOMencoding::UTF_8)))
+		{
+			xml::checkUTF8(xmlFile, start, length);
+		}
+
+		tok.reset();
+		builder.take();
+		tok.run(start, start + length);
+		return builder.take();
+	};
+
+	std::uint64_t seen = 0;
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(this->m_mutex);
+			this->m_wake.wait(lock, [this, seen]()
+			{
+				return this->m_stop || this->m_batch != seen;
+			});
+			if (this->m_stop)
+			{
+				return;
+			}
+			seen = this->m_batch;
+		}
+
+		for (std::size_t i; (i = this->m_next++) < this->m_count;)
+		{
+			try
+			{
+				this->m_results[i].node = parseOne(this->m_docs[i]);
+			}
+			catch (...)
+			{
+				this->m_results[i].error = std::current_exception();
+			}
+		}
+
+		std::lock_guard<std::mutex> lock(this->m_mutex);
+		if (--this->m_busy == 0)
+		{
+			this->m_done.notify_all();
+		}
+	}
+}
+inline std::vector<xmlite::batchparser::result> xmlite::batchparser::parse(const strview * docs, std::size_t count)
+{
+	std::vector<result> results(count);
+	if (count == 0)
+	{
+		return results;
+	}
+
+	std::lock_guard<std::mutex> batchLock(this->m_batchMutex);
+	{
+		std::lock_guard<std::mutex> lock(this->m_mutex);
+		this->m_docs    = docs;
+		this->m_results = results.data();
+		this->m_count   = count;
+		this->m_next    = 0;
+		this->m_busy    = this->m_workers.size();
+		++this->m_batch;
+	}
+	this->m_wake.notify_all();
+
+	std::unique_lock<std::mutex> lock(this->m_mutex);
+	this->m_done.wait(lock, [this]()
+	{
+		return this->m_busy == 0;
+	});
+	return results;
+}
+
+inline void xmlite::writer::beginNode()
+{
+	this->closeStartTag();
+	if (this->m_style == dumpStyle::Pretty)
+	{
+		if (this->m_written)
+		{
+			this->m_out.put('\n');
+		}
+		this->m_out.fill('\t', this->m_nameStarts.size());
+	}
+	this->m_written = true;
+}
+inline void xmlite::writer::closeStartTag()
+{
+	if (this->m_inStartTag)
+	{
+		this->m_out.put('>');
+		this->m_inStartTag = false;
+	}
+}
+inline void xmlite::writer::value(const char * str, std::size_t len)
+{
+	inner::escape(this->m_out, str, str + len);
+}
+inline xmlite::writer & xmlite::writer::declaration(xml::version ver)
+{
+	if (this->m_written)
+	{
+		throw exception(exception::Type::WriteIncorrectOrder);
+	}
+	this->m_out.put("<?xml version=\"", 15);
+	const char * verStr = xml::versionStr[underlying_cast(ver)];
+	this->m_out.put(verStr, std::strlen(verStr));
+	this->m_out.put("\" encoding=\"UTF-8\"?>", 20);
+	this->m_written = true;
+	return *this;
+}
+inline xmlite::writer & xmlite::writer::start(strview name)
+{
+	if (name.empty() || (this->m_nameStarts.empty() && this->m_rootDone))
+	{
+		throw exception(exception::Type::WriteIncorrectOrder);
+	}
+	this->beginNode();
+	this->m_out.put('<');
+	this->m_out.put(name.data(), name.size());
+
+	this->m_nameStarts.push_back(this->m_names.size());
+	this->m_names.append(name.data(), name.size());
+	this->m_inStartTag = true;
+	return *this;
+}
+inline xmlite::writer & xmlite::writer::attr(strview name, strview value)
+{
+	if (!this->m_inStartTag || name.empty())
+	{
+		throw exception(exception::Type::WriteIncorrectOrder);
+	}
+	this->m_out.put(' ');
+	this->m_out.put(name.data(), name.size());
+	this->m_out.put("=\"", 2);
+	this->value(value.data(), value.size());
+	this->m_out.put('"');
+	return *this;
+}
+inline xmlite::writer & xmlite::writer::text(strview value)
+{
+	// Character data is only allowed inside the root element
+	if (this->m_nameStarts.empty())
+	{
+		throw exception(exception::Type::WriteIncorrectOrder);
+	}
+	this->beginNode();
+	this->value(value.data(), value.size());
+	return *this;
+}
+inline xmlite::writer & xmlite::writer::comment(strview value)
+{
+	for (const char * it = value.begin(); it != value.end(); ++it)
+	{
+		if (*it == '-' && (it + 1 == value.end() || *(it + 1) == '-'))
+		{
+			throw exception(exception::Type::ParseComment2Dashes);
+		}
+	}
+	this->beginNode();
+	this->m_out.put("<!--", 4);
+	this->m_out.put(value.data(), value.size());
+	this->m_out.put("-->", 3);
+	return *this;
+}
+inline xmlite::writer & xmlite::writer::end()
+{
+	if (this->m_nameStarts.empty())
+	{
+		throw exception(exception::Type::WriteIncorrectNesting);
+	}
+
+	const std::size_t nameStart = this->m_nameStarts.back();
+	this->m_nameStarts.pop_back();
+	if (this->m_inStartTag)
+	{
+		this->m_out.put("/>", 2);
+		this->m_inStartTag = false;
+	}
+	else
+	{
+		if (this->m_style == dumpStyle::Pretty)
+		{
+			this->m_out.put('\n');
+			this->m_out.fill('\t', this->m_nameStarts.size());
+		}
+		this->m_out.put("</", 2);
+		this->m_out.put(this->m_names.data() + nameStart, this->m_names.size() - nameStart);
+		this->m_out.put('>');
+	}
+	this->m_names.resize(nameStart);
+	this->m_rootDone = this->m_nameStarts.empty();
+	return *this;
+}
+inline xmlite::writer & xmlite::writer::end(strview name)
+{
+	if (this->m_nameStarts.empty())
+	{
+		throw exception(exception::Type::WriteIncorrectNesting);
+	}
+	const std::size_t nameStart = this->m_nameStarts.back();
+	if (strview(this->m_names.data() + nameStart, this->m_names.size() - nameStart) != name)
+	{
+		throw name.empty() ? exception(exception::Type::WriteIncorrectNesting) :
+			exception(exception::Type::WriteIncorrectNesting, name.data(), name.size());
+	}
+	return this->end();
+}
+inline void xmlite::writer::finish()
+{
+	if (!this->m_nameStarts.empty())
+	{
+		throw exception(exception::Type::WriteIncorrectNesting, this->m_names.data() + this->m_nameStarts.back(),
+			this->m_names.size() - this->m_nameStarts.back()
+		);
+	}
+	else if (!this->m_rootDone)
+	{
+		throw exception(exception::Type::ParseNoRoot);
+	}
+	this->m_out.flush();
+}
+
+inline std::string xmlite::escapeChars(const char * valStr, std::size_t valLen)
+{
+	valLen = strlen(valStr, valLen);
+
+	std::string esc(valStr, valLen);
+	inner::decodeEntities(esc);
+	return esc;
+}
+inline xmlite::strview xmlite::decodeEntities(strview value, std::string & buf)
+{
+	const char * amp = inner::findChar(value.begin(), value.end(), '&');
+	if (amp == value.end())
+	{
+		return value;
+	}
+
+	// The part before the first reference is copied as it is
+	const std::size_t clean = std::size_t(amp - value.begin());
+	buf.resize(value.size());
+	std::memcpy(&buf[0], value.data(), clean);
+	buf.resize(std::size_t(inner::decodeEntities(&buf[clean], amp, value.end()) - buf.data()));
+	return buf;
+}
+
+
+inline std::string xmlite::UTF32toUTF8(char32_t c)
+{
+	std::string utf8;
+	utf8.reserve(1);
+
+	using u8 = typename std::uint8_t;
+
+	std::size_t nby = c <= 0x7FU ? 1 : c <= 0x7FFU ? 2 : c <= 0xFFFFU ? 3 : c <= 0x1FFFFFU ? 4 : c <= 0x3FFFFFFU ? 5 : c <= 0x7FFFFFFFU ? 6 : 7;
+	utf8 += nby <= 1 ? u8(c) : ((u8(0xFFU) << (8 - nby)) | u8(c >> (6 * (nby - 1))));
+	for (std::size_t i = 1; i < nby; ++i)
+	{
+		utf8 += u8(0x80U | (u8(0x3FU) & u8(c >> (6 * (nby - 1 - i)))));
+	}
+
+	return utf8;
+}
+inline std::uint32_t xmlite::UTF16toCodePoint(char16_t ch1, char16_t optCh2, bool & secondUsed) noexcept
+{
+	if ((ch1 <= 0xD7FF) || (ch1 >= 0xE000))
+	{
+		secondUsed = false;
+		return std::uint32_t(ch1);
+	}
+	else if (ch1 >= 0xD800 && ch1 <= 0xDFFF)
+	{
+		secondUsed = true;
+		return (std::uint32_t(ch1 - 0xD800) << 10) + std::uint32_t(optCh2 - 0xDC00) + 0x10000;
+	}
+	else
+	{
+		return 0;
+	}
+}
+inline std::string xmlite::UTFCodePointToUTF8(std::uint32_t c)
+{
+	if (c > 0x01FFFFF)
+	{
+		return {};
+	}
+	char buf[4];
+	return { buf, inner::encodeUTF8(buf, c) };
+}
+
+// Both take code units in the host's byte order
+inline std::string xmlite::UTF32toUTF8(const char32_t * utfStr, std::size_t length)
+{
+	length = strlen(utfStr, length);
+	auto bytes = reinterpret_cast<const char *>(utfStr);
+	return inner::hostBigEndian() ?
+		inner::transcode<4, true>(bytes, bytes + length * 4) :
+		inner::transcode<4, false>(bytes, bytes + length * 4);
+}
+inline std::string xmlite::UTF16toUTF8(const char16_t * utfStr, std::size_t length)
+{
+	length = strlen(utfStr, length);
+	auto bytes = reinterpret_cast<const char *>(utfStr);
+	return inner::hostBigEndian() ?
+		inner::transcode<2, true>(bytes, bytes + length * 2) :
+		inner::transcode<2, false>(bytes, bytes + length * 2);
+}
+inline std::string xmlite::UTF7toUTF8(const char * utfStr, std::size_t length)
+{
+	length = strlen(utfStr, length);
+
+	// Value of every base64 digit, -1 for characters that end a shift sequence
+	static constexpr const std::int8_t base64[256]
+	{
+		-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+		-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+		-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 62, -1, -1, -1, 63,
+		52, 53, 54, 55, 56, 57, 58, 59, 60, 61, -1, -1, -1, -1, -1, -1,
+		-1,  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14,
+		15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, -1, -1, -1, -1, -1,
+		-1, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40,
+		41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, -1, -1, -1, -1, -1,
+		-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+		-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+		-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+		-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+		-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+		-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+		-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+		-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1
+	};
+
+	// A byte of input never takes more than 1.5 bytes of UTF-8
+	std::string utf8;
+	utf8.resize(length + length / 2 + 4);
+	char * out = &utf8[0];
+
+	for (const char * end = utfStr + length; utfStr != end;)
+	{
+		// Directly encoded characters are copied up to the next shift
+		auto shift = static_cast<const char *>(std::memchr(utfStr, '+', std::size_t(end - utfStr)));
+		shift = shift != nullptr ? shift : end;
+		std::memcpy(out, utfStr, std::size_t(shift - utfStr));
+		out   += shift - utfStr;
+		utfStr = shift;
+		if (utfStr == end)
+		{
+			break;
+		}
+
+		++utfStr;
+		if (utfStr != end && *utfStr == '-')
+		{
+			*out++ = '+';
+			++utfStr;
+			continue;
+		}
+
+		// Sextets are gathered until there are 16 bits for a UTF-16 code unit
+		std::uint32_t bits = 0, high = 0;
+		unsigned numBits = 0;
+		for (; utfStr != end; ++utfStr)
+		{
+			const std::int8_t sextet = base64[std::uint8_t(*utfStr)];
+			if (sextet < 0)
+			{
+				break;
+			}
+			bits = (bits << 6) | std::uint32_t(sextet);
+			numBits += 6;
+			if (numBits < 16)
+			{
+				continue;
+			}
+
+			numBits -= 16;
+			const std::uint32_t unit = (bits >> numBits) & 0xFFFF;
+			bits &= (std::uint32_t(1) << numBits) - 1;
+
+			if (high != 0)
+			{
+				if (unit >= 0xDC00 && unit <= 0xDFFF)
+				{
+					out  = inner::encodeUTF8(out, ((high - 0xD800) << 10) + (unit - 0xDC00) + 0x10000);
+					high = 0;
+					continue;
+				}
+				out  = inner::encodeUTF8(out, inner::replacementChar);
+				high = 0;
+			}
+			if (unit >= 0xD800 && unit <= 0xDBFF)
+			{
+				high = unit;
+			}
+			else
+			{
+				out = inner::encodeUTF8(out, unit >= 0xDC00 && unit <= 0xDFFF ? inner::replacementChar : unit);
+			}
+		}
+		if (high != 0)
+		{
+			out = inner::encodeUTF8(out, inner::replacementChar);
+		}
+
+		// '-' only ends the shift sequence, any other character is taken as is
+		if (utfStr != end && *utfStr == '-')
+		{
+			++utfStr;
+		}
+	}
+
+	utf8.resize(std::size_t(out - utf8.data()));
+	return utf8;
+}
+inline std::string xmlite::UTF1toUTF8(const char * utfStr, std::size_t length)
+{
+	constexpr std::uint32_t range = 190, range2 = range * range, range3 = range2 * range, range4 = range2 * range2;
+
+	length = strlen(utfStr, length);
+
+	// Value of every trailing byte in the 190-digit UTF-1 range
+	static constexpr const std::uint8_t digit[256]
+	{
+		  0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+		  0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+		  0,   0,   1,   2,   3,   4,   5,   6,   7,   8,   9,  10,  11,  12,  13,  14,
+		 15,  16,  17,  18,  19,  20,  21,  22,  23,  24,  25,  26,  27,  28,  29,  30,
+		 31,  32,  33,  34,  35,  36,  37,  38,  39,  40,  41,  42,  43,  44,  45,  46,
+		 47,  48,  49,  50,  51,  52,  53,  54,  55,  56,  57,  58,  59,  60,  61,  62,
+		 63,  64,  65,  66,  67,  68,  69,  70,  71,  72,  73,  74,  75,  76,  77,  78,
+		 79,  80,  81,  82,  83,  84,  85,  86,  87,  88,  89,  90,  91,  92,  93,   0,
+		  0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+		  0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+		 94,  95,  96,  97,  98,  99, 100, 101, 102, 103, 104, 105, 106, 107, 108, 109,
+		110, 111, 112, 113, 114, 115, 116, 117, 118, 119, 120, 121, 122, 123, 124, 125,
+		126, 127, 128, 129, 130, 131, 132, 133, 134, 135, 136, 137, 138, 139, 140, 141,
+		142, 143, 144, 145, 146, 147, 148, 149, 150, 151, 152, 153, 154, 155, 156, 157,
+		158, 159, 160, 161, 162, 163, 164, 165, 166, 167, 168, 169, 170, 171, 172, 173,
+		174, 175, 176, 177, 178, 179, 180, 181, 182, 183, 184, 185, 186, 187, 188, 189
+	};
+
+	// A byte of input takes at most 2 bytes of UTF-8, every sequence is at least as long as its UTF-8 form but 80-9F
+	std::string utf8;
+	utf8.resize(length * 2 + 4);
+	char * out = &utf8[0];
+
+	for (const char * end = utfStr + length; utfStr != end;)
+	{
+		// Runs of ASCII are copied a word at a time
+		const char * run = utfStr;
+		for (std::uint64_t word; end - run >= 8; run += 8)
+		{
+			std::memcpy(&word, run, 8);
+			if ((word & 0x8080808080808080) != 0)
+			{
+				break;
+			}
+		}
+		while (run != end && std::uint8_t(*run) <= 0x7F)
+		{
+			++run;
+		}
+		std::memcpy(out, utfStr, std::size_t(run - utfStr));
+		out   += run - utfStr;
+		utfStr = run;
+		if (utfStr == end)
+		{
+			break;
+		}
+
+		auto b = reinterpret_cast<const std::uint8_t *>(utfStr);
+		const std::uint8_t ch = b[0];
+		// UTF-1 length of 1
+		if (ch <= 0x9F)
+		{
+			*out++ = char(0xC2);
+			*out++ = char(ch);
+			++utfStr;
+			continue;
+		}
+
+		// Other lengths are told apart by the lead byte: A0-F5 take 2 bytes, F6-FB 3 bytes & FC-FF 5 bytes
+		const std::size_t len = ch <= 0xF5 ? 2 : ch <= 0xFB ? 3 : 5;
+		// A truncated sequence at the end is dropped, like a partial UTF-16 or UTF-32 code unit
+		if (std::size_t(end - utfStr) < len)
+		{
+			break;
+		}
+
+		std::uint64_t codePoint;
+		if (len == 2)
+		{
+			codePoint = ch == 0xA0 ? b[1] : std::uint32_t(ch - 0xA1) * range + digit[b[1]] + 0x0100;
+		}
+		else if (len == 3)
+		{
+			codePoint = std::uint32_t(ch - 0xF6) * range2 + digit[b[1]] * range + digit[b[2]] + 0x4016;
+		}
+		else
+		{
+			// FE & FF only lead values above U+10FFFF, FF can reach past 32 bits
+			codePoint = std::uint64_t(ch - 0xFC) * range4 + std::uint64_t(digit[b[1]]) * range3 +
+				digit[b[2]] * range2 + digit[b[3]] * range + digit[b[4]] + 0x038E2E;
+		}
+		utfStr += len;
+		const bool invalid = codePoint > 0x10FFFF || (codePoint >= 0xD800 && codePoint <= 0xDFFF);
+		out = inner::encodeUTF8(out, invalid ? inner::replacementChar : std::uint32_t(codePoint));
+	}
+
+	utf8.resize(std::size_t(out - utf8.data()));
+	return utf8;
+}
+
+template<typename Handler>
+inline const char * xmlite::inner::tokenizer<Handler>::run(const char * start, const char * end, bool final)
+{
+	auto find = findChar;
+	auto findStr = [find](const char * it, const char * end, const char * str, std::size_t len) -> const char *
+	{
+		for (; std::size_t(end - it) >= len; ++it)
+		{
+			it = find(it, end - len + 1, *str);
+			if (it == end - len + 1)
+			{
+				break;
+			}
+			else if (std::memcmp(it, str, len) == 0)
+			{
+				return it;
+			}
+		}
+		return end;
+	};
+	auto startsWith = [](const char * it, const char * end, const char * str, std::size_t len)
+	{
+		return std::size_t(end - it) >= len && std::memcmp(it, str, len) == 0;
+	};
+	// Whether the rest could still turn into one of the markers that take more than a byte or two to tell apart
+	auto markerPrefix = [](const char * it, const char * end)
+	{
+		const std::size_t len = std::size_t(end - it);
+		return (len < 9 && std::memcmp(it, "<![CDATA[", len) == 0) ||
+			(len < 5 && std::memcmp(it, "<?xml", len) == 0) ||
+			(len < 4 && std::memcmp(it, "<!--", len) == 0);
+	};
+	auto skipWhiteSpace = [](const char * it, const char * end)
+	{
+		return findNonWhiteSpace(it, end);
+	};
+	// Takes the position after '&', returns the position after the escape sequence or nullptr if it's invalid
+	auto escapeEnd = [](const char * it, const char * end)
+	{
+		std::uint32_t c;
+		return entityRef(it, end, c);
+	};
+
+
+	const bool validate = this->m_validate;
+
+	// The first construct was cut by the end of the last run, its end isn't before this
+	const char * resume = start + this->m_resume;
+	this->m_resume = 0;
+	auto cut = [this](const char * tokStart, const char * scanned)
+	{
+		this->m_resume = std::size_t(scanned - tokStart);
+		return tokStart;
+	};
+
+	const char * it = start;
+	while (it != end)
+	{
+		// Everything up to the next tag is text
+		const char * tagStart = *it == '<' ? it : find(it < resume ? resume : it, end, '<');
+		if (tagStart == end && !final)
+		{
+			return cut(it, end);
+		}
+		else if (tagStart != it)
+		{
+			if (validate)
+			{
+				for (const char * esc = find(it, tagStart, '&'); esc != tagStart; esc = find(esc, tagStart, '&'))
+				{
+					esc = escapeEnd(esc + 1, tagStart);
+					if (esc == nullptr)
+					{
+						throw exception(exception::Type::ParseIncorrectEscapeCharacter);
+					}
+				}
+			}
+			this->m_handler.text(it, std::size_t(tagStart - it));
+			it = tagStart;
+			if (it == end)
+			{
+				break;
+			}
+		}
+
+		// Too short to tell what the markup is
+		const char * tokStart = it;
+		if (!final && markerPrefix(it, end))
+		{
+			return it;
+		}
+
+		if (startsWith(it, end, "<!--", 4))
+		{
+			const char * commentStart = it + 4;
+			const char * commentEnd = commentStart < resume ? resume : commentStart;
+			while (true)
+			{
+				commentEnd = findStr(commentEnd, end, "--", 2);
+				if (commentEnd == end)
+				{
+					if (!final)
+					{
+						// The last '-' may start the terminator
+						return cut(tokStart, end - 1);
+					}
+					else if (validate)
+					{
+						throw exception(exception::Type::ParseIncorrectComment);
+					}
+					return end;
+				}
+				else if ((commentEnd + 2) != end && *(commentEnd + 2) == '>')
+				{
+					break;
+				}
+				else if ((commentEnd + 2) == end && !final)
+				{
+					return cut(tokStart, commentEnd);
+				}
+				else if (validate)
+				{
+					throw exception(exception::Type::ParseComment2Dashes);
+				}
+				++commentEnd;
+			}
+			this->m_handler.comment(commentStart, std::size_t(commentEnd - commentStart));
+			it = commentEnd + 3;
+		}
+		else if (startsWith(it, end, "<![CDATA[", 9))
+		{
+			const char * dataStart = it + 9;
+			const char * dataEnd = findStr(dataStart < resume ? resume : dataStart, end, "]]>", 3);
+			if (dataEnd == end)
+			{
+				if (!final)
+				{
+					return cut(tokStart, end - 2);
+				}
+				else if (validate)
+				{
+					throw exception(exception::Type::ParseIncorrectTag);
+				}
+				return end;
+			}
+			this->m_handler.cdata(dataStart, std::size_t(dataEnd - dataStart));
+			it = dataEnd + 3;
+		}
+		else if (startsWith(it, end, "<?", 2))
+		{
+			// Processing instructions & the XML header are skipped
+			const bool header = startsWith(it, end, "<?xml", 5);
+			it = findStr(it + 2 < resume ? resume : it + 2, end, "?>", 2);
+			if (it == end)
+			{
+				if (!final)
+				{
+					return cut(tokStart, end - 1);
+				}
+				else if (!validate)
+				{
+					return end;
+				}
+				else if (header)
+				{
+					throw exception(exception::Type::ParseIncorrectHeaderTerminator);
+				}
+				throw exception(exception::Type::ParseIncorrectTag);
+			}
+			it += 2;
+			this->m_header |= header;
+			if (header && this->m_edges != nullptr)
+			{
+				this->m_edges->edges.push_back({ chunkedges::kind::Header, 0, 0 });
+			}
+		}
+		else if (startsWith(it, end, "<!", 2))
+		{
+			// Declarations, e.g DOCTYPE, might contain a bracketed internal subset
+			std::size_t brackets = 0;
+			for (it += 2; it != end; ++it)
+			{
+				if (*it == '[')
+				{
+					++brackets;
+				}
+				else if (*it == ']' && brackets != 0)
+				{
+					--brackets;
+				}
+				else if (*it == '>' && brackets == 0)
+				{
+					break;
+				}
+			}
+			if (it == end)
+			{
+				if (!final)
+				{
+					return tokStart;
+				}
+				else if (validate)
+				{
+					throw exception(exception::Type::ParseIncorrectTag);
+				}
+				return end;
+			}
+			++it;
+		}
+		else if (!final && find(it < resume ? resume : it, end, '>') == end)
+		{
+			// Start & end tags can't be complete yet
+			return cut(it, end);
+		}
+		else if (startsWith(it, end, "</", 2))
+		{
+			const char * nameStart = it + 2;
+			for (it = nameStart; it != end && *it != '>' && !isWhiteSpace(*it); ++it);
+			const char * nameEnd = it;
+			const std::size_t nameLen = std::size_t(nameEnd - nameStart);
+
+			if (validate)
+			{
+				if (!this->m_tagStarts.empty())
+				{
+					const std::size_t top = this->m_tagStarts.back(), topLen = this->m_tagNames.size() - top;
+					if (topLen != nameLen || std::memcmp(this->m_tagNames.data() + top, nameStart, nameLen) != 0)
+					{
+						throw exception(exception::Type::ParseNoTerminatingTag, this->m_tagNames.data() + top, topLen);
+					}
+					this->m_tagNames.resize(top);
+					this->m_tagStarts.pop_back();
+				}
+				else if (this->m_edges != nullptr)
+				{
+					this->m_edges->edges.push_back({ chunkedges::kind::Close, this->m_edges->names.size(), nameLen });
+					this->m_edges->names.append(nameStart, nameLen);
+				}
+				else
+				{
+					throw exception(exception::Type::ParseIncorrectTag);
+				}
+
+				it = skipWhiteSpace(it, end);
+				if (it == end || *it != '>')
+				{
+					throw exception(exception::Type::ParseIncorrectTag);
+				}
+			}
+			else
+			{
+				it = find(it, end, '>');
+				if (it == end)
+				{
+					return end;
+				}
+			}
+			++it;
+			this->m_handler.endElement(nameStart, nameLen);
+		}
+		else
+		{
+			const char * nameStart = it + 1;
+			for (it = nameStart; it != end && *it != '>' && *it != '/' && !isWhiteSpace(*it); ++it);
+			const char * nameEnd = it;
+			const std::size_t nameLen = std::size_t(nameEnd - nameStart);
+
+			std::size_t newRoot = 0;
+			if (validate)
+			{
+				if (nameLen == 0)
+				{
+					throw exception(exception::Type::ParseIncorrectTag);
+				}
+				else if (this->m_tagStarts.empty())
+				{
+					if (this->m_edges != nullptr)
+					{
+						this->m_edges->edges.push_back({ chunkedges::kind::Root, 0, 0 });
+					}
+					else if (!this->m_header)
+					{
+						throw exception(exception::Type::ParseIncorrectHeader);
+					}
+					else if (this->m_roots != 0)
+					{
+						throw exception(exception::Type::ParseTooManyRoots);
+					}
+					newRoot = 1;
+					++this->m_roots;
+				}
+			}
+			// The '>' that was found is inside an attribute value, nothing has been reported yet
+			auto cut = [&]()
+			{
+				this->m_roots -= newRoot;
+				if (newRoot != 0 && this->m_edges != nullptr)
+				{
+					this->m_edges->edges.pop_back();
+				}
+				return tokStart;
+			};
+
+			this->m_attrs.clear();
+			bool selfClosing = false;
+			while (true)
+			{
+				it = skipWhiteSpace(it, end);
+				if (it == end)
+				{
+					if (!final)
+					{
+						return cut();
+					}
+					else if (validate)
+					{
+						throw exception(exception::Type::ParseIncorrectTag);
+					}
+					return end;
+				}
+				else if (*it == '>')
+				{
+					++it;
+					break;
+				}
+				else if (*it == '/')
+				{
+					++it;
+					if (it != end && *it == '>')
+					{
+						selfClosing = true;
+						++it;
+						break;
+					}
+					else if (it == end && !final)
+					{
+						return cut();
+					}
+					else if (validate)
+					{
+						throw exception(exception::Type::ParseIncorrectTag);
+					}
+					continue;
+				}
+
+				// Attribute
+				const char * attrStart = it;
+				for (; it != end && *it != '=' && *it != '>' && *it != '/' && !isWhiteSpace(*it); ++it);
+				const char * attrEnd = it;
+
+				it = skipWhiteSpace(it, end);
+				if (it == end && !final)
+				{
+					return cut();
+				}
+				else if (it == end || *it != '=' || attrStart == attrEnd)
+				{
+					if (validate)
+					{
+						throw exception(exception::Type::ParseIncorrectTag);
+					}
+					continue;
+				}
+				it = skipWhiteSpace(it + 1, end);
+				if (it == end && !final)
+				{
+					return cut();
+				}
+				else if (it == end || (*it != '"' && *it != '\''))
+				{
+					if (validate)
+					{
+						throw exception(exception::Type::ParseIncorrectTag);
+					}
+					continue;
+				}
+
+				const char quote = *it;
+				const char * valueStart = it + 1;
+				const char * valueEnd;
+				if (validate)
+				{
+					// One scan for the closing quote, '<' and escape sequences
+					for (valueEnd = findAny(valueStart, end, quote, '<', '&'); valueEnd != end && *valueEnd != quote;)
+					{
+						const char * next = *valueEnd == '&' ? escapeEnd(valueEnd + 1, end) : nullptr;
+						if (next == nullptr)
+						{
+							// A missing quote takes precedence, then '<' anywhere in the value
+							const char * quoteEnd = find(valueEnd, end, quote);
+							if (quoteEnd == end)
+							{
+								valueEnd = end;
+								break;
+							}
+							throw exception(find(valueEnd, quoteEnd, '<') != quoteEnd ?
+								exception::Type::ParseIncorrectTag : exception::Type::ParseIncorrectEscapeCharacter
+							);
+						}
+						valueEnd = findAny(next, end, quote, '<', '&');
+					}
+				}
+				else
+				{
+					valueEnd = find(valueStart, end, quote);
+				}
+				if (valueEnd == end)
+				{
+					if (!final)
+					{
+						return cut();
+					}
+					else if (validate)
+					{
+						throw exception(exception::Type::ParseNoTerminatingQuote, attrStart, std::size_t(attrEnd - attrStart));
+					}
+					return end;
+				}
+				it = valueEnd + 1;
+
+				this->m_attrs.push_back({
+					{ attrStart,  std::size_t(attrEnd - attrStart) },
+					{ valueStart, std::size_t(valueEnd - valueStart) }
+				});
+			}
+
+			if (validate && !selfClosing)
+			{
+				this->m_tagStarts.push_back(this->m_tagNames.size());
+				this->m_tagNames.append(nameStart, nameLen);
+			}
+
+			this->m_handler.startElement(nameStart, nameLen, this->m_attrs.data(), this->m_attrs.size());
+			if (selfClosing)
+			{
+				this->m_handler.endElement(nameStart, nameLen);
+			}
+		}
+	}
+
+	if (validate && final && this->m_edges == nullptr)
+	{
+		if (!this->m_header)
+		{
+			throw exception(exception::Type::ParseIncorrectHeader);
+		}
+		else if (!this->m_tagStarts.empty())
+		{
+			const std::size_t top = this->m_tagStarts.back();
+			throw exception(exception::Type::ParseNoTerminatingTag, this->m_tagNames.data() + top, this->m_tagNames.size() - top);
+		}
+		else if (this->m_roots == 0)
+		{
+			throw exception(exception::Type::ParseNoRoot);
+		}
+	}
+	return end;
+}
+
+inline xmlite::xmlnode xmlite::xmlnode::innerParse(const char * xml, std::size_t len)
+{
+	xmlite::xmlnode node;
+
+	// Parsing functions
+	auto parseTag = [&node](const char *& start, const char * end, bool & ended)
+	{
+		ended = false;
+
+		const char * tagStart = nullptr, * tagEnd = nullptr;
+		for (; start != end; ++start)
+		{
+			if (*start == '<')
+			{
+				tagStart = start + 1;
+			}
+			else if (tagStart != nullptr)
+			{
+				if (*start == '>')
+				{
+					if (*(start - 1) == '/')
+					{
+						ended = true;
+					}
+					tagEnd = start - ended;
+					break;
+				}
+			}
+		}
+		if (tagStart == nullptr || tagEnd == nullptr)
+		{
+			return;
+		}
+
+		const char * it = tagStart + 1, * tagRealEnd = tagEnd;
+		for (; it != tagEnd; ++it)
+		{
+			if (*it == ' ' || *it == '\n' || *it == '\t' || *it == '\r')
+			{
+				tagRealEnd = it;
+				break;
+			}
+		}
+
+		node.m_tag = { tagStart, std::size_t(tagRealEnd - tagStart) };
+		
+		if (tagRealEnd == tagEnd)
+		{
+			return;
+		}
+
+
+		tagStart = tagRealEnd + 1;
+		while (tagStart != tagEnd)
+		{
+			it = tagStart;
+			const char * attrStart = nullptr, * attrEnd = nullptr;
+			for (; it != tagEnd; ++it)
+			{
+				if (!(*it == ' ' || *it == '\n' || *it == '\t' || *it == '\r'))
+				{
+					// Attribute start
+					attrStart = it;
+					break;
+				}
+			}
+			for (; it != tagEnd; ++it)
+			{
+				if (*it == ' ' || *it == '\n' || *it == '\t' || *it == '=' || *it == '\r')
+				{
+					attrEnd = it;
+					break;
+				}
+			}
+			for (; it != tagEnd; ++it)
+			{
+				if (*it == '=')
+				{
+					break;
+				}
+			}
+			const char * attrValueStart = nullptr, * attrValueEnd = nullptr;
+			for (; it != tagEnd; ++it)
+			{
+				if (*it == '"')
+				{
+					++it;
+					attrValueStart = it;
+					break;
+				}
+			}
+			for (; it != tagEnd; ++it)
+			{
+				if (*it == '"')
+				{
+					attrValueEnd = it;
+					++it;
+					break;
+				}
+			}
+			tagStart = it;
+
+			if (attrStart != nullptr && attrEnd != nullptr && attrValueStart != nullptr && attrValueEnd != nullptr)
+			{
+				node.elem().attributes.emplace(
+					std::string{ attrStart, std::size_t(attrEnd - attrStart) },
+					std::string{ attrValueStart, std::size_t(attrValueEnd - attrValueStart) }
+				);
+			}
+		}
+	};
+	auto parseTagStop = [](const char * it, const char * end) -> const char *
+	{
+		// Find tag and its ending, return end of ending
+		const char * tagStart = nullptr, * tagEnd = nullptr;
+		bool ended = false;
+		for (; it != end; ++it)
+		{
+			if (*it == '<')
+			{
+				tagStart = it + 1;
+			}
+			else if (tagStart != nullptr)
+			{
+				if (*it == '>')
+				{
+					if (*(it - 1) == '/')
+					{
+						ended = true;
+					}
+					tagEnd = it + 1;
+					break;
+				}
+			}
+		}
+		if (tagStart == nullptr || tagEnd == nullptr)
+		{
+			return nullptr;
+		}
+
+		it = tagStart + 1;
+		const char * tagRealEnd = tagEnd;
+		for (; it != tagEnd; ++it)
+		{
+			if (*it == ' ' || *it == '\n' || *it == '\t' || *it == '\r')
+			{
+				tagRealEnd = it;
+				break;
+			}
+		}
+
+		if (ended == true)
+		{
+			return tagEnd;
+		}
+
+		// Find end
+		for (; (it = inner::findChar(it, end, '<')) != end; ++it)
+		{
+			if (strncmp(it, "</", 2) == 0)
+			{
+				it += 2;
+				if (strncmp(it, tagStart, tagRealEnd - tagStart) == 0)
+				{
+					break;
+				}
+			}
+		}
+
+		for (; it != end; ++it)
+		{
+			if (*it == '>')
+			{
+				return it;
+			}
+		}
+
+		return nullptr;
+	};
+	auto parseTagContents = [&node, parseTagStop](const char *& start, const char * end)
+	{
+		std::string valueStr;
+		bool prevWhiteSpace = false;
+
+		for (; start != end; ++start)
+		{
+			// Parse as usual
+			if (*start == '<')
+			{
+				if (*(start + 1) == '/')
+				{
+					break;
+				}
+				// Start new tag parsing
+				if (!valueStr.empty())
+				{
+					node.add(std::move(valueStr));
+					valueStr.clear();
+				}
+				prevWhiteSpace = false;
+
+				auto tagEnd = parseTagStop(start, end);
+				node.add(innerParse(start, tagEnd - start));
+				start = tagEnd;
+			}
+			else
+			{
+				if (*start == '\t' || *start == '\n' || *start == ' ' || *start == '\r')
+				{
+					prevWhiteSpace = true;
+				}
+				else
+				{
+					if (prevWhiteSpace)
+					{
+						valueStr += ' ';
+						prevWhiteSpace = false;
+					}
+					valueStr += *start;
+				}
+			}
+		}
+		if (!valueStr.empty())
 		{
-			return this->dumpHeader() + '\n' + this->m_nodes.dump();
+			node.add(std::move(valueStr));
 		}
-
-	};
-
-	constexpr const char * xml::versionStr[];
-	constexpr const std::uint8_t xml::BOMLength[];
-	constexpr const char * xml::BOMStrings[];
-}
-
-
-inline std::string xmlite::convertDOM(const char * bomStr, std::size_t length)
-{
-	length = strlen(bomStr, length);
-	
-	auto convertBOM_UTF16 = [](const char * str, std::size_t len)
-	{
-		auto realStr = reinterpret_cast<const char16_t *>(str);
-		auto realLen = len / 2;
-		
-		return xmlite::UTF16toUTF8(realStr, realLen);
 	};
 
-	auto convertBOM_UTF32 = [](const char * str, std::size_t len)
-	{
-		auto realStr = reinterpret_cast<const char32_t *>(str);
-		auto realLen = len / 4;
-
-		return xmlite::UTF32toUTF8(realStr, realLen);
-	};
 
-	auto bom = xml::getBOM(bomStr, length);
-	auto bomLen = xml::BOMLength[bom];
 
-	switch (static_cast<xml::BOMencoding>(bom))
-	{
-	case xml::BOMencoding::UTF_1:
-		return xmlite::UTF1toUTF8(bomStr + bomLen, length - bomLen);
-	case xml::BOMencoding::UTF_7:
-		return xmlite::UTF7toUTF8(bomStr + bomLen, length - bomLen);
-	case xml::BOMencoding::UTF_8:
-		return { bomStr + bomLen, length - bomLen };
-	case xml::BOMencoding::UTF_16LE:
-		return convertBOM_UTF16(bomStr + bomLen, length - bomLen);
-	case xml::BOMencoding::UTF_16BE:
+	const char * start = xml, * end = xml + len;
+	for (; start != end;)
 	{
-		std::string UTF16LEStr{ bomStr + bomLen, length - bomLen };
-		// Convert big endian to little endian
-		for (auto it = UTF16LEStr.begin(); it != UTF16LEStr.end(); it += 2)
+		// if found tag, add it to key
+		bool ended;
+		parseTag(start, end, ended);
+		if (start == end)
 		{
-			std::swap(*it, *(it + 1));
+			break;
 		}
-
-		return convertBOM_UTF16(UTF16LEStr.c_str(), UTF16LEStr.length());
-	}
-	case xml::BOMencoding::UTF_32LE:
-		return convertBOM_UTF32(bomStr + bomLen, length - bomLen);
-	case xml::BOMencoding::UTF_32BE:
-	{
-		std::string UTF32LEStr{ bomStr + bomLen, length - bomLen };
-		// Convert big endian to little endian
-		for (auto it = UTF32LEStr.begin(); it != UTF32LEStr.end(); it += 4)
+		else if (ended == false && !node.m_tag.empty())
 		{
-			std::swap(*it,       *(it + 3));
-			std::swap(*(it + 1), *(it + 2));
+			++start;
+			parseTagContents(start, end);
+			break;
+		}
+		else if (ended == true)
+		{
+			++start;
 		}
-
-		return convertBOM_UTF32(UTF32LEStr.c_str(), UTF32LEStr.length());
-	}
-	default:
-		return { bomStr, length };
 	}
+
+	return node;
 }
-inline std::string xmlite::escapeChars(const char * valStr, std::size_t valLen)
+inline xmlite::xmlnode xmlite::xmlnode::innerParseLinear(const char * xml, std::size_t len, bool validate, bool decode)
 {
-	valLen = strlen(valStr, valLen);
-	
-	std::string esc;
-	esc.reserve(valLen);
+	builder b(decode);
+	inner::tokenizer<builder> tok(b, validate);
+	tok.run(xml, xml + len);
 
-	auto escapeChar = [&esc](const char *& start, const char * end)
+	return std::move(b.root);
+}
+inline xmlite::xmlnode xmlite::xmlnode::innerParseParallel(const char * xml, std::size_t len, bool validate, bool decode, std::size_t threads)
+{
+	// Builds the root element & notes where its content can be split, between children of the root
+	struct splitter
 	{
-		if (*start != '&')
+		builder rootBuilder;
+		const char * end;
+		std::size_t target;
+		std::size_t depth{ 0 };
+		bool rootDone{ false };
+
+		const char * contentEnd{ nullptr };
+		std::vector<const char *> splits;
+
+		splitter(bool decode, const char * e, std::size_t t)
+			: rootBuilder(decode), end(e), target(t)
 		{
-			return;
 		}
-		++start;
-		if (*start == '#')
+
+		void startElement(const char * name, std::size_t nameLen, const attrview * attrs, std::size_t numAttrs)
 		{
-			// Numbers
-			++start;
-			esc += UTFCodePointToUTF8(std::uint32_t(atoi(start)));
-			for (; start != end; ++start)
+			if (this->depth == 0)
 			{
-				if (*start == ';')
+				if (this->rootDone)
 				{
-					break;
+					return;
 				}
+				this->rootBuilder.startElement(name, nameLen, attrs, numAttrs);
+
+				const char * tagEnd = numAttrs != 0 ? attrs[numAttrs - 1].value.end() + 1 : name + nameLen;
+				tagEnd = inner::findChar(tagEnd, this->end, '>');
+				this->splits.push_back(tagEnd != this->end ? tagEnd + 1 : this->end);
 			}
-		}
-		else
-		{
-			if (strncmp(start, "lt;", 3) == 0)
-			{
-				esc += '<';
-				start += 2;
-			}
-			else if (strncmp(start, "gt;", 3) == 0)
-			{
-				esc += '>';
-				start += 2;
-			}
-			else if (strncmp(start, "quot;", 5) == 0)
+			else if (this->depth == 1 && std::size_t(name - 1 - this->splits.back()) >= this->target)
 			{
-				esc += '"';
-				start += 4;
+				// Text is flushed before every child, so no text node spans a split
+				this->splits.push_back(name - 1);
 			}
-			else if (strncmp(start, "apos;", 5) == 0)
+			++this->depth;
+		}
+		void endElement(const char * name, std::size_t)
+		{
+			if (this->depth == 0)
 			{
-				esc += '\'';
-				start += 4;
+				return;
 			}
-			else if (strncmp(start, "amp;", 4) == 0)
+			--this->depth;
+			if (this->depth == 0)
 			{
-				esc += '&';
-				start += 3;
+				this->rootDone = true;
+				// A self-closing root has no content
+				this->contentEnd = name - 2 >= this->splits.front() ? name - 2 : this->splits.front();
 			}
 		}
-
-	};
-
-	for (const char * end = valStr + valLen; valStr != end; ++valStr)
-	{
-		if (*valStr == '&')
+		void text(const char *, std::size_t)
 		{
-			// escape
-			escapeChar(valStr, end);
 		}
-		else
+		void cdata(const char *, std::size_t)
 		{
-			// Just add character to end
-			esc += *valStr;
 		}
-	}
-	esc.shrink_to_fit();
-	return esc;
-}
-
-
-inline std::string xmlite::UTF32toUTF8(char32_t c)
-{
-	std::string utf8;
-	utf8.reserve(1);
-
-	using u8 = typename std::uint8_t;
-
-	std::size_t nby = c <= 0x7FU ? 1 : c <= 0x7FFU ? 2 : c <= 0xFFFFU ? 3 : c <= 0x1FFFFFU ? 4 : c <= 0x3FFFFFFU ? 5 : c <= 0x7FFFFFFFU ? 6 : 7;
-	utf8 += nby <= 1 ? u8(c) : ((u8(0xFFU) << (8 - nby)) | u8(c >> (6 * (nby - 1))));
-	for (std::size_t i = 1; i < nby; ++i)
-	{
-		utf8 += u8(0x80U | (u8(0x3FU) & u8(c >> (6 * (nby - 1 - i)))));
-	}
+		void comment(const char *, std::size_t)
+		{
+		}
+	};
 
-	return utf8;
-}
-inline std::uint32_t xmlite::UTF16toCodePoint(char16_t ch1, char16_t optCh2, bool & secondUsed) noexcept
-{
-	if ((ch1 <= 0xD7FF) || (ch1 >= 0xE000))
+	// A few sections per thread even out children of different sizes
+	const std::size_t target = len / (threads * 8) > 64 * 1024 ? len / (threads * 8) : 64 * 1024;
+	splitter split(decode, xml + len, target);
 	{
-		secondUsed = false;
-		return std::uint32_t(ch1);
+		inner::tokenizer<splitter> tok(split, validate);
+		tok.run(xml, xml + len);
 	}
-	else if (ch1 >= 0xD800 && ch1 <= 0xDFFF)
+	xmlnode root = std::move(split.rootBuilder.root);
+	if (split.splits.empty())
 	{
-		secondUsed = true;
-		return (std::uint32_t(ch1 - 0xD800) << 10) + std::uint32_t(optCh2 - 0xDC00) + 0x10000;
+		return root;
 	}
-	else
+	const char * contentEnd = split.contentEnd != nullptr ? split.contentEnd : xml + len;
+
+	// The document has already been checked, sections are tokenized without validation
+	const std::size_t numSections = split.splits.size();
+	std::vector<xmlnode> sections(numSections);
+	std::atomic<std::size_t> next{ 0 };
+	std::exception_ptr error;
+	std::mutex errorMutex;
+	auto work = [&]()
 	{
-		return 0;
-	}
-}
-inline std::string xmlite::UTFCodePointToUTF8(std::uint32_t c)
-{
-	std::string utf8;
-	utf8.reserve(1);
+		for (std::size_t i; (i = next++) < numSections;)
+		{
+			try
+			{
+				builder b(decode);
+				b.stack.push_back(&b.root);
+				inner::tokenizer<builder> tok(b, false);
+				tok.run(split.splits[i], i + 1 < numSections ? split.splits[i + 1] : contentEnd);
+				if (!b.stack.empty())
+				{
+					b.flushText();
+				}
+				sections[i] = std::move(b.root);
+			}
+			catch (...)
+			{
+				std::lock_guard<std::mutex> lock(errorMutex);
+				if (error == nullptr)
+				{
+					error = std::current_exception();
+				}
+				next = numSections;
+			}
+		}
+	};
 
-	if (c <= 0x7F)
+	std::vector<std::thread> workers;
+	const std::size_t numWorkers = threads < numSections ? threads : numSections;
+	try
 	{
-		utf8 += char(c);
+		for (std::size_t i = 1; i < numWorkers; ++i)
+		{
+			workers.emplace_back(work);
+		}
 	}
-	else if (c <= 0x07FF)
+	catch (...)
 	{
-		utf8 += 0xC0 | ((c >> 6) & 0x1F);
-		utf8 += 0x80 | (c        & 0x3F);
+		// Whoever was started does the rest
 	}
-	else if (c <= 0xFFFF)
+	work();
+	for (auto & worker : workers)
 	{
-		utf8 += 0xE0 | ((c >> 12) & 0x0F);
-		utf8 += 0x80 | ((c >> 6)  & 0x3F);
-		utf8 += 0x80 | (c         & 0x3F);
+		worker.join();
 	}
-	else if (c <= 0x01FFFFF)
+	if (error != nullptr)
 	{
-		utf8 += 0xF0 | ((c >> 18) & 0x07);
-		utf8 += 0x80 | ((c >> 12) & 0x3F);
-		utf8 += 0x80 | ((c >> 6)  & 0x3F);
-		utf8 += 0x80 | (c         & 0x3F);
+		std::rethrow_exception(error);
 	}
 
-	return utf8;
-}
-
-inline std::string xmlite::UTF32toUTF8(const char32_t * utfStr, std::size_t length)
-{
-	length = strlen(utfStr, length);
-
-	std::string utf8;
-	utf8.reserve(length);
-
-	for (const char32_t * end = utfStr + length; utfStr != end; ++utfStr)
+	// Sections are joined in document order
+	std::size_t total = 0;
+	for (const auto & section : sections)
 	{
-		utf8 += UTF32toUTF8(*utfStr);
+		total += section.m_values.size();
 	}
-
-	utf8.shrink_to_fit();
-	return utf8;
-}
-inline std::string xmlite::UTF16toUTF8(const char16_t * utfStr, std::size_t length)
-{
-	length = strlen(utfStr, length);
-
-	std::string utf8;
-	utf8.reserve(length);
-
-	for (const char16_t * end = utfStr + length; utfStr != end; ++utfStr)
+	root.m_values.reserve(total);
+	for (auto & section : sections)
 	{
-		bool secondUsed;
-		const char16_t ch2 = ((utfStr + 1) != end) ? *(utfStr + 1) : 0;
-		utf8 += UTFCodePointToUTF8(UTF16toCodePoint(*utfStr, ch2, secondUsed));
-		utfStr += secondUsed;
+		for (auto & child : section.m_values)
+		{
+			root.m_values.push_back(std::move(child));
+		}
 	}
-
-	utf8.shrink_to_fit();
-	return utf8;
+	if (total != 0)
+	{
+		root.m_role = objtype::Object;
+	}
+	return root;
 }
-inline std::string xmlite::UTF7toUTF8(const char * utfStr, std::size_t length)
+inline void xmlite::xmlnode::finishParse(bool decode)
 {
-	length = strlen(utfStr, length);
-
-	std::string utf8;
-	utf8.reserve(length);
-
-	auto fromBase64 = [](char ch)
+	std::vector<xmlnode *> stack{ this };
+	while (!stack.empty())
 	{
-		if (ch >= 'A' && ch <= 'Z')
-		{
-			return ch - 'A';
-		}
-		else if (ch >= 'a' && ch <= 'z')
+		auto node = stack.back();
+		stack.pop_back();
+
+		node->m_escaped = !decode;
+		if (decode && node->m_role == objtype::EndPoint)
 		{
-			return ch - 'a' + 26;
+			inner::decodeEntities(node->m_tag);
 		}
-		else if (ch >= '0' && ch <= '9')
+		else if (decode && node->m_elem.get() != nullptr)
 		{
-			return ch - '0' + 52;
+			for (auto & a : node->m_elem->attributes)
+			{
+				inner::decodeEntities(a.second);
+			}
 		}
-		else if (ch == '+')
+		for (auto & child : node->m_values)
 		{
-			return 62;
+			stack.push_back(&child);
 		}
-		else if (ch == '/')
+	}
+}
+
+inline xmlite::xmlnode::xmlnode(const char * xmlFile, std::size_t length, const parseOptions & options)
+{
+	const char * start = xmlFile, * end = xmlFile + length;
+	
+	std::string str;
+
+	auto BOM = xml::getBOM(xmlFile, length);
+	if (BOM != -1)
+	{
+		if (BOM != underlying_cast(xml::BOMencoding::UTF_8))
 		{
-			return 63;
+			str   = xmlite::convertDOM(xmlFile, length);
+			start = str.c_str();
+			end   = str.c_str() + str.length();
 		}
 		else
 		{
-			return 0;
+			start += xml::BOMLength[BOM];
 		}
-	};
+	}
+	if (options.validateUTF8 && (BOM == -1 || BOM == underlying_cast(xml::BOMencoding::UTF_8)))
+	{
+		xml::checkUTF8(xmlFile, start, std::size_t(end - start));
+	}
 
-	auto utfBufToStr = [&utf8](const char16_t * utfBuf, std::uint8_t shifts)
+	if (options.engine == parseEngine::Recursive)
 	{
-		std::uint8_t chs = 0;
-		for (std::uint8_t i = 0, m = shifts / 16; i < m; ++i)
+		if (!options.trusted)
 		{
-			bool useAux;
-			if (i < (m - 1))
-			{
-				utf8 += UTFCodePointToUTF8(UTF16toCodePoint(utfBuf[i], utfBuf[i + 1], useAux));
-				i += useAux;
-				chs += 1 + useAux;
-			}
-			else
-			{
-				auto codePoint = UTF16toCodePoint(utfBuf[i], 0, useAux);
-				if (!useAux)
-				{
-					utf8 += UTFCodePointToUTF8(codePoint);
-					++chs;
-				}
-				else
-				{
-					break;
-				}
-			}
+			xml::innerCheck(start, end - start);
 		}
-		return chs;
-	};
 
-	for (const char * end = utfStr + length; utfStr != end; ++utfStr)
-	{
-		if (*utfStr == '+')
+		for (; start != end; ++start)
 		{
-			++utfStr;
-			if (*utfStr == '-')
+			if (strncmp(start, "?>", 2) == 0)
 			{
-				utf8 += '+';
+				start += 2;
+				break;
 			}
-			else
-			{
-				// Decode code point
-				char16_t utfBuf[3] = { 0 };
-				std::uint8_t utfIdx = 0, shifts = 0;
-				for (; utfStr != end && *utfStr != '\0'; ++utfStr)
-				{
-					if (*utfStr == '-')
-					{
-						break;
-					}
-
-					// Add code point
-					shifts += 6;
-					char16_t num = char16_t(fromBase64(*utfStr));
-					std::uint8_t idx = shifts / 16, shifts16 = utfIdx * 16 + 16;
-					if (utfIdx == idx)
-					{
-						utfBuf[utfIdx] |= num << (shifts16 - shifts);
-					}
-					else
-					{
-						utfBuf[utfIdx] |= num >> (shifts - shifts16);
-						++utfIdx;
-						if (shifts != shifts16)
-						{
-							utfBuf[utfIdx] |= num << (shifts16 + 16 - shifts);
-						}
-					}
-					if (shifts != 0 && (shifts % 16) == 0)
-					{
-						std::uint8_t chs = utfBufToStr(utfBuf, shifts);
+		}
 
-						if (chs != 0)
-						{
-							shifts -= 16 * chs;
-							std::memmove(utfBuf, &utfBuf[chs], (3 - chs) * sizeof(char16_t));
-							std::memset(&utfBuf[3 - chs], 0, chs * sizeof(char16_t));
-							utfIdx -= chs;
-						}
-					}
-				}
-				utfBufToStr(utfBuf, shifts);
-			}
+		*this = innerParse(start, end - start);
+		this->finishParse(options.decodeEntities);
+	}
+	else
+	{
+		const std::size_t threads = options.threads != 0 ? options.threads : std::thread::hardware_concurrency();
+		if (threads > 1 && std::size_t(end - start) >= inner::parallelMinSize)
+		{
+			*this = innerParseParallel(start, end - start, !options.trusted, options.decodeEntities, threads);
 		}
 		else
 		{
-			utf8 += *utfStr;
+			*this = innerParseLinear(start, end - start, !options.trusted, options.decodeEntities);
 		}
 	}
-
-	return utf8;
 }
-inline std::string xmlite::UTF1toUTF8(const char * utfStr, std::size_t length)
+
+inline xmlite::xmldoc::xmldoc(const char * xmlFile, std::size_t length, const parseOptions & options)
 {
-	constexpr std::uint32_t range = 190, range2 = range * range, range3 = range2 * range, range4 = range2 * range2;
+	length = strlen(xmlFile, length);
 
-	length = strlen(utfStr, length);
+	const bool views = options.storage == docStorage::View;
 
-	std::string utf8;
-	utf8.reserve(length);
+	auto bom = xml::getBOM(xmlFile, length);
+	if ((bom == -1 || bom == underlying_cast(xml::BOMencoding::UTF_8)) && options.validateUTF8)
+	{
+		const std::size_t skip = bom == -1 ? 0 : xml::BOMLength[bom];
+		xml::checkUTF8(xmlFile, xmlFile + skip, length - skip);
+	}
 
-	auto toUTF1Range = [](std::uint8_t ch) -> std::uint8_t
+	if (bom == underlying_cast(xml::BOMencoding::UTF_8))
 	{
-		if (ch > 0x20 && ch < 0x7F)
-		{
-			return ch - 0x21;
-		}
-		else if (ch > 0x9F)
-		{
-			return ch - 0xA0 + 0x5E;
-		}
-		else
+		this->build(xmlFile + xml::BOMLength[bom], length - xml::BOMLength[bom], options);
+	}
+	else if (bom != -1)
+	{
+		auto buf = std::make_shared<const std::string>(xmlite::convertDOM(xmlFile, length));
+		this->build(buf->c_str(), buf->length(), options);
+		if (views)
 		{
-			return 0;
+			this->m_source = std::move(buf);
 		}
-	};
+	}
+	else
+	{
+		this->build(xmlFile, length, options);
+	}
+}
 
-	for (const char * end = utfStr + length; utfStr != end; ++utfStr)
+inline xmlite::xmldoc::nodeidx xmlite::xmldoc::newNode(nodeidx parent, nodetype type, strview str)
+{
+	if (this->m_nodes.size() >= npos)
+	{
+		throw exception(exception::Type::OutOfBounds);
+	}
+	auto idx = nodeidx(this->m_nodes.size());
+	this->m_nodes.emplace_back();
+	auto & n = this->m_nodes.back();
+	n.type   = type;
+	n.str    = str;
+	n.parent = parent;
+	if (parent != npos)
 	{
-		std::uint8_t ch = *utfStr;
-		// UTF-1 length of 1
-		if (ch <= 0x9F)
+		auto & p = this->m_nodes[parent];
+		if (p.lastChild != npos)
 		{
-			if (ch > 0x7F)
-			{
-				utf8 += char(0xC2);
-			}
-			utf8 += ch;
+			this->m_nodes[p.lastChild].nextSibling = idx;
+			n.prevSibling = p.lastChild;
 		}
-		// Other lengths
 		else
 		{
-			std::uint32_t codePoint = 0;
-			// Length of 2
-			if (ch <= 0xF5)
-			{
-				if (utfStr + 1 == end)
-				{
-					break;
-				}
-				++utfStr;
-				const std::uint8_t ch2 = *utfStr;
-				
-				if (ch == 0xA0)
-				{
-					utf8 += 0xC2 + (ch2 > 0xBF);
-					utf8 += ch2  - (ch2 > 0xBF) * 0x40;
-					continue;
-				}
-				else
-				{
-					codePoint = std::uint32_t(ch - 0xA1) * range + std::uint32_t(toUTF1Range(ch2)) + 0x0100;
-				}
-			}
-			// Length of 3
-			else if (ch <= 0xFB)
-			{
-				if (utfStr + 2 == end)
-				{
-					break;
-				}
-				++utfStr;
-				const std::uint8_t ch2 = *utfStr;
-				++utfStr;
-				const std::uint8_t ch3 = *utfStr;
-
-				codePoint = std::uint32_t(ch - 0xF6) * range2 + toUTF1Range(ch2) * range + toUTF1Range(ch3) + 0x4016;
-			}
-			// Length of 5
-			else if (ch <= 0xFD)
-			{
-				if (utfStr + 4 == end)
-				{
-					break;
-				}
-				++utfStr;
-				const std::uint8_t ch2 = *utfStr;
-				++utfStr;
-				const std::uint8_t ch3 = *utfStr;
-				++utfStr;
-				const std::uint8_t ch4 = *utfStr;
-				++utfStr;
-				const std::uint8_t ch5 = *utfStr;
-
-				codePoint = std::uint32_t(ch - 0xFC) * range4 + toUTF1Range(ch2) * range3 +
-					toUTF1Range(ch3) * range2 + toUTF1Range(ch4) * range + toUTF1Range(ch5) + 0x038E2E;
-			}
-			utf8 += UTFCodePointToUTF8(codePoint);
+			p.firstChild = idx;
 		}
+		p.lastChild = idx;
 	}
-
-	return utf8;
+	return idx;
 }
+inline xmlite::xmldoc::atom xmlite::xmldoc::intern(const char * str, std::size_t len)
+{
+	auto it = this->m_atoms.find(strview(str, len));
+	if (it != this->m_atoms.end())
+	{
+		return it->second;
+	}
+	if (this->m_names.size() >= noAtom)
+	{
+		throw exception(exception::Type::OutOfBounds);
+	}
 
-inline xmlite::xmlnode xmlite::xmlnode::innerParse(const char * xml, std::size_t len)
+	auto a = atom(this->m_names.size());
+	this->m_names.push_back(this->m_views ? strview(str, len) : this->m_arena.store(str, len));
+	this->m_atoms.emplace(this->m_names.back(), a);
+	return a;
+}
+inline void xmlite::xmldoc::build(const char * xml, std::size_t len, const parseOptions & options)
 {
-	xmlite::xmlnode node;
+	this->m_views   = options.storage == docStorage::View;
+	this->m_decoded = options.decodeEntities;
 
-	// Parsing functions
-	auto parseTag = [&node](const char *& start, const char * end, bool & ended)
+	struct builder
 	{
-		ended = false;
+		xmldoc & doc;
+		std::vector<nodeidx> stack;
+		bool rootDone{ false };
+		bool decode;
 
-		const char * tagStart = nullptr, * tagEnd = nullptr;
-		for (; start != end; ++start)
+		builder(xmldoc & d, bool dec) noexcept
+			: doc(d), decode(dec)
 		{
-			if (*start == '<')
-			{
-				tagStart = start + 1;
-			}
-			else if (tagStart != nullptr)
-			{
-				if (*start == '>')
-				{
-					if (*(start - 1) == '/')
-					{
-						ended = true;
-					}
-					tagEnd = start - ended;
-					break;
-				}
-			}
 		}
-		if (tagStart == nullptr || tagEnd == nullptr)
+
+		strview keep(const char * str, std::size_t len)
 		{
-			return;
+			return this->doc.m_views ? strview(str, len) : this->doc.m_arena.store(str, len);
 		}
-
-		const char * it = tagStart + 1, * tagRealEnd = tagEnd;
-		for (; it != tagEnd; ++it)
+		// Resolved values are decoded straight into the arena, in view mode only values with references are copied
+		strview keepValue(const char * str, std::size_t len, bool & escaped)
 		{
-			if (*it == ' ' || *it == '\n' || *it == '\t' || *it == '\r')
+			const bool refs = std::memchr(str, '&', len) != nullptr;
+			escaped = refs && !this->decode;
+			if (!refs || !this->decode)
 			{
-				tagRealEnd = it;
-				break;
+				return this->keep(str, len);
 			}
+			auto mem = static_cast<char *>(this->doc.m_arena.allocate(len, 1));
+			return { mem, std::size_t(inner::decodeEntities(mem, str, str + len) - mem) };
 		}
 
-		node.m_tag = { tagStart, std::size_t(tagRealEnd - tagStart) };
-		
-		if (tagRealEnd == tagEnd)
-		{
-			return;
-		}
-
-
-		tagStart = tagRealEnd + 1;
-		while (tagStart != tagEnd)
+		void startElement(const char * name, std::size_t nameLen, const attrview * attrs, std::size_t numAttrs)
 		{
-			it = tagStart;
-			const char * attrStart = nullptr, * attrEnd = nullptr;
-			for (; it != tagEnd; ++it)
-			{
-				if (!(*it == ' ' || *it == '\n' || *it == '\t' || *it == '\r'))
-				{
-					// Attribute start
-					attrStart = it;
-					break;
-				}
-			}
-			for (; it != tagEnd; ++it)
-			{
-				if (*it == ' ' || *it == '\n' || *it == '\t' || *it == '=' || *it == '\r')
-				{
-					attrEnd = it;
-					break;
-				}
-			}
-			for (; it != tagEnd; ++it)
-			{
-				if (*it == '=')
-				{
-					break;
-				}
-			}
-			const char * attrValueStart = nullptr, * attrValueEnd = nullptr;
-			for (; it != tagEnd; ++it)
+			if (this->stack.empty() && this->rootDone)
 			{
-				if (*it == '"')
-				{
-					++it;
-					attrValueStart = it;
-					break;
-				}
+				return;
 			}
-			for (; it != tagEnd; ++it)
+
+			auto tag = this->doc.intern(name, nameLen);
+			auto idx = this->doc.newNode(
+				this->stack.empty() ? npos : this->stack.back(),
+				nodetype::Element,
+				this->doc.m_names[tag]
+			);
+			auto & n = this->doc.m_nodes[idx];
+			n.name = tag;
+			if (numAttrs != 0)
 			{
-				if (*it == '"')
+				n.attrs    = std::uint32_t(this->doc.m_attrs.size());
+				n.numAttrs = std::uint32_t(numAttrs);
+				for (std::size_t i = 0; i < numAttrs; ++i)
 				{
-					attrValueEnd = it;
-					++it;
-					break;
+					this->doc.m_attrs.emplace_back();
+					auto & attr = this->doc.m_attrs.back();
+					attr.nameAtom = this->doc.intern(attrs[i].name.data(), attrs[i].name.size());
+					attr.name     = this->doc.m_names[attr.nameAtom];
+					attr.value    = this->keepValue(attrs[i].value.data(), attrs[i].value.size(), attr.escaped);
 				}
 			}
-			tagStart = it;
-
-			if (attrStart != nullptr && attrEnd != nullptr && attrValueStart != nullptr && attrValueEnd != nullptr)
+			this->stack.push_back(idx);
+		}
+		void endElement(const char *, std::size_t)
+		{
+			if (this->stack.empty())
 			{
-				node.m_attributes.emplace(
-					std::string{ attrStart, std::size_t(attrEnd - attrStart) },
-					std::string{ attrValueStart, std::size_t(attrValueEnd - attrValueStart) }
-				);
+				return;
 			}
+			this->stack.pop_back();
+			this->rootDone = this->stack.empty();
 		}
-	};
-	auto parseTagStop = [](const char * it, const char * end) -> const char *
-	{
-		// Find tag and its ending, return end of ending
-		const char * tagStart = nullptr, * tagEnd = nullptr;
-		bool ended = false;
-		for (; it != end; ++it)
+		void text(const char * str, std::size_t strLen)
 		{
-			if (*it == '<')
+			if (this->stack.empty())
 			{
-				tagStart = it + 1;
+				return;
 			}
-			else if (tagStart != nullptr)
+			if (inner::findNonWhiteSpace(str, str + strLen) != str + strLen)
 			{
-				if (*it == '>')
-				{
-					if (*(it - 1) == '/')
-					{
-						ended = true;
-					}
-					tagEnd = it + 1;
-					break;
-				}
+				bool escaped;
+				auto value = this->keepValue(str, strLen, escaped);
+				this->doc.m_nodes[this->doc.newNode(this->stack.back(), nodetype::Text, value)].escaped = escaped;
 			}
 		}
-		if (tagStart == nullptr || tagEnd == nullptr)
-		{
-			return nullptr;
-		}
-
-		it = tagStart + 1;
-		const char * tagRealEnd = tagEnd;
-		for (; it != tagEnd; ++it)
+		// CDATA has no references, it's stored like resolved character data
+		void cdata(const char * str, std::size_t strLen)
 		{
-			if (*it == ' ' || *it == '\n' || *it == '\t' || *it == '\r')
+			if (this->stack.empty())
 			{
-				tagRealEnd = it;
-				break;
+				return;
 			}
-		}
-
-		if (ended == true)
-		{
-			return tagEnd;
-		}
-
-		// Find end
-		for (; it != end; ++it)
-		{
-			if (strncmp(it, "</", 2) == 0)
+			if (inner::findNonWhiteSpace(str, str + strLen) != str + strLen)
 			{
-				it += 2;
-				if (strncmp(it, tagStart, tagRealEnd - tagStart) == 0)
-				{
-					break;
-				}
+				this->doc.newNode(this->stack.back(), nodetype::Text, this->keep(str, strLen));
 			}
 		}
-
-		for (; it != end; ++it)
+		void comment(const char *, std::size_t)
 		{
-			if (*it == '>')
-			{
-				return it;
-			}
 		}
-
-		return nullptr;
 	};
-	auto parseTagContents = [&node, parseTagStop](const char *& start, const char * end)
-	{
-		std::string valueStr;
-		bool prevWhiteSpace = false;
 
-		for (; start != end; ++start)
+	builder b(*this, options.decodeEntities);
+	inner::tokenizer<builder> tok(b, !options.trusted);
+	tok.run(xml, xml + len);
+}
+inline void xmlite::xmldoc::clone(const xmldoc & other)
+{
+	// Links are indices, so the arrays can be copied as they are
+	this->m_nodes   = other.m_nodes;
+	this->m_attrs   = other.m_attrs;
+	// Views keep pointing to the same buffer
+	this->m_source  = other.m_source;
+	this->m_views   = other.m_views;
+	this->m_decoded = other.m_decoded;
+	if (this->m_views)
+	{
+		this->m_names = other.m_names;
+		this->m_atoms = other.m_atoms;
+		// Decoded values live in the other document's arena, they're copied
+		if (other.m_arena.numBlocks() != 0)
 		{
-			// Parse as usual
-			if (*start == '<')
+			for (auto & n : this->m_nodes)
 			{
-				if (*(start + 1) == '/')
-				{
-					break;
-				}
-				// Start new tag parsing
-				if (!valueStr.empty())
+				if (n.type == nodetype::Text && other.m_arena.owns(n.str.data()))
 				{
-					node.add(valueStr);
-					valueStr.clear();
+					n.str = this->m_arena.store(n.str.data(), n.str.size());
 				}
-				prevWhiteSpace = false;
-
-				auto tagEnd = parseTagStop(start, end);
-				auto parsedNode = innerParse(start, tagEnd - start);
-				node.add(parsedNode);
-				start = tagEnd;
 			}
-			else
+			for (auto & a : this->m_attrs)
 			{
-				if (*start == '\t' || *start == '\n' || *start == ' ' || *start == '\r')
-				{
-					prevWhiteSpace = true;
-				}
-				else
+				if (other.m_arena.owns(a.value.data()))
 				{
-					if (prevWhiteSpace)
-					{
-						valueStr += ' ';
-						prevWhiteSpace = false;
-					}
-					valueStr += *start;
+					a.value = this->m_arena.store(a.value.data(), a.value.size());
 				}
 			}
 		}
-		if (!valueStr.empty())
-		{
-			node.add(valueStr);
-		}
-	};
+		return;
+	}
 
+	this->m_names.reserve(other.m_names.size());
+	for (auto name : other.m_names)
+	{
+		this->intern(name.data(), name.size());
+	}
+	for (auto & n : this->m_nodes)
+	{
+		n.str = n.type == nodetype::Element ? this->m_names[n.name] : this->m_arena.store(n.str.data(), n.str.size());
+	}
+	for (auto & a : this->m_attrs)
+	{
+		a.name  = this->m_names[a.nameAtom];
+		a.value = this->m_arena.store(a.value.data(), a.value.size());
+	}
+}
+inline std::string xmlite::xmldoc::noderef::value() const
+{
+	std::string valueStr;
+	if (!this->isText())
+	{
+		return valueStr;
+	}
+	const auto & n = this->get();
+	inner::collapseWhiteSpace(valueStr, n.str.data(), n.str.size());
+	if (n.escaped)
+	{
+		inner::decodeEntities(valueStr);
+	}
+	return valueStr;
+}
+inline xmlite::xmlnode xmlite::xmldoc::toNode() const
+{
+	xmlnode root;
+	if (this->m_nodes.empty())
+	{
+		return root;
+	}
 
+	std::vector<std::pair<nodeidx, xmlnode *>> stack;
+	stack.emplace_back(0, &root);
+	root.m_tag = this->m_nodes[0].str.str();
 
-	const char * start = xml, * end = xml + len;
-	for (; start != end;)
+	std::string valueStr, cdataStr;
+	while (!stack.empty())
 	{
-		// if found tag, add it to key
-		bool ended;
-		parseTag(start, end, ended);
-		if (start == end)
+		const auto & src = this->m_nodes[stack.back().first];
+		auto dst = stack.back().second;
+		stack.pop_back();
+
+		// Values are in escaped form unless they were decoded, like the ones the xmlnode parser makes
+		dst->m_escaped = !this->m_decoded;
+		for (std::size_t i = src.attrs, end = src.attrs + src.numAttrs; i < end; ++i)
 		{
-			break;
+			dst->elem().attributes.emplace(this->m_attrs[i].name.str(), this->m_attrs[i].value.str());
 		}
-		else if (ended == false && !node.m_tag.empty())
+
+		std::size_t numElems = 0;
+		for (auto c = src.firstChild; c != npos; c = this->m_nodes[c].nextSibling)
 		{
-			++start;
-			parseTagContents(start, end);
-			break;
+			const auto & child = this->m_nodes[c];
+			if (child.type == nodetype::Text)
+			{
+				valueStr.clear();
+				inner::collapseWhiteSpace(valueStr, child.str.data(), child.str.size());
+				// Only CDATA has '<' or '&' without being escaped
+				if (!this->m_decoded && !child.escaped && inner::findAny(valueStr.data(), valueStr.data() + valueStr.size(), '<', '&') != valueStr.data() + valueStr.size())
+				{
+					cdataStr.clear();
+					inner::stringwriter out{ cdataStr };
+					inner::escape(out, valueStr.data(), valueStr.data() + valueStr.size());
+					valueStr.swap(cdataStr);
+				}
+				dst->add(valueStr);
+				dst->m_values.back().m_escaped = !this->m_decoded;
+			}
+			else
+			{
+				dst->emplace(child.str.str());
+				++numElems;
+			}
 		}
-		else if (ended == true)
+
+		// Children are only pushed once the parent's child vector is final
+		if (numElems != 0)
 		{
-			++start;
+			std::size_t idx = 0;
+			for (auto c = src.firstChild; c != npos; c = this->m_nodes[c].nextSibling, ++idx)
+			{
+				if (this->m_nodes[c].type == nodetype::Element)
+				{
+					stack.emplace_back(c, &dst->m_values[idx]);
+				}
+			}
 		}
 	}
 
-	return node;
+	return root;
 }
 
-inline xmlite::xmlnode::xmlnode(const char * xmlFile, std::size_t length)
+template<typename Sink>
+inline void xmlite::xmlnode::dumpTo(Sink & sink, const dumpOptions & options) const
 {
-	const char * start = xmlFile, * end = xmlFile + length;
-	
-	std::string str;
+	const bool pretty = options.style == dumpStyle::Pretty;
 
-	auto BOM = xml::getBOM(xmlFile, length);
-	if (BOM != -1)
+	auto value = [&sink](const xmlnode & node, const std::string & str, bool attr)
 	{
-		if (BOM != underlying_cast(xml::BOMencoding::UTF_8))
+		if (node.m_escaped)
 		{
-			str   = xmlite::convertDOM(xmlFile, length);
-			start = str.c_str();
-			end   = str.c_str() + str.length();
+			inner::escapeInvalid(sink, str.data(), str.data() + str.size(), attr);
 		}
 		else
 		{
-			start += xml::BOMLength[BOM];
+			inner::escape(sink, str.data(), str.data() + str.size());
 		}
-	}
-
-	xml::innerCheck(start, end - start);
-
-	for (; start != end; ++start)
+	};
+	auto startTag = [&sink, &value](const xmlnode & node)
 	{
-		if (strncmp(start, "?>", 2) == 0)
+		sink.put('<');
+		sink.put(node.m_tag.data(), node.m_tag.size());
+		for (const auto & i : node.attrs())
 		{
-			start += 2;
-			break;
+			sink.put(' ');
+			sink.put(i.first.data(), i.first.size());
+			sink.put("=\"", 2);
+			value(node, i.second, true);
+			sink.put('"');
 		}
-	}
-
-	*this = innerParse(start, end - start);
-}
-
-inline std::string xmlite::xmlnode::innerDump(std::size_t depth) const
-{
-	if (this->m_role == objtype::Object)
+	};
+	// Writes everything up to the children, true if the node has any
+	auto open = [&](const xmlnode & node, std::size_t depth)
 	{
-		std::string str;
-		str.append(depth, '\t');
-		
-		str += '<' + this->m_tag;
-		for (const auto & i : this->m_attributes)
+		if (node.m_role == objtype::EmptyObject && node.attrs().empty())
 		{
-			str += ' ' + i.first + "=\"" + i.second + '"';
+			return false;
 		}
-
-		str += '>';
-
-		for (const auto & i : this->m_values)
+		if (pretty)
 		{
-			str += '\n';
-			str += i.innerDump(depth + 1);
+			sink.fill('\t', depth);
 		}
-
-		str += '\n';
-		for (std::size_t i = 0; i < depth; ++i)
+		if (node.m_role == objtype::EndPoint)
+		{
+			value(node, node.m_tag, false);
+			return false;
+		}
+		startTag(node);
+		if (node.m_role == objtype::EmptyObject)
 		{
-			str += '\t';
+			sink.put("/>", 2);
+			return false;
 		}
-		str += "</" + this->m_tag + '>';
-		
-		return str;
-	}
-	else if (this->m_role == objtype::EndPoint)
+		sink.put('>');
+		return true;
+	};
+
+	// Open elements with the index of the next child to write, the depth is the stack size
+	std::vector<std::pair<const xmlnode *, std::size_t>> stack;
+	if (open(*this, 0))
 	{
-		return std::string(depth, '\t') + this->m_tag;
+		stack.emplace_back(this, 0);
 	}
-	else if (!this->m_attributes.empty())
+	while (!stack.empty())
 	{
-		std::string str;
-		str.append(depth, '\t');
-
-		str += '<' + this->m_tag;
-		for (const auto & i : this->m_attributes)
+		const xmlnode & node = *stack.back().first;
+		const std::size_t depth = stack.size() - 1;
+		if (stack.back().second < node.m_values.size())
 		{
-			str += ' ' + i.first + "=\"" + i.second + '"';
+			const xmlnode & child = node.m_values[stack.back().second++];
+			if (pretty)
+			{
+				sink.put('\n');
+			}
+			if (open(child, depth + 1))
+			{
+				stack.emplace_back(&child, 0);
+			}
+			continue;
 		}
-		str += "/>";
 
-		return str;
+		if (pretty)
+		{
+			sink.put('\n');
+			sink.fill('\t', depth);
+		}
+		sink.put("</", 2);
+		sink.put(node.m_tag.data(), node.m_tag.size());
+		sink.put('>');
+		stack.pop_back();
 	}
-	else
+}
+inline void xmlite::xmlnode::dump(std::string & out, const dumpOptions & options) const
+{
+	if (options.exactSize)
 	{
-		return {};
+		inner::sizecounter counter;
+		this->dumpTo(counter, options);
+		out.reserve(out.size() + counter.size);
 	}
+	inner::stringwriter writer{ out };
+	this->dumpTo(writer, options);
 }
 
 inline void xmlite::xml::innerCheck(const char * xml, std::size_t len)
@@ -1356,7 +5897,7 @@ inline void xmlite::xml::innerCheck(const char * xml, std::size_t len)
 	{
 		const auto & currentTag = tagStack.top();
 
-		for (; s != end; ++s)
+		for (; (s = inner::findChar(s, end, '<')) != end; ++s)
 		{
 			if (strncmp(s, "</", 2) == 0 && strncmp(s + 2, currentTag.addr, currentTag.len) == 0 &&
 				*(s + 2 + currentTag.len) == '>'
@@ -1402,36 +5943,14 @@ inline void xmlite::xml::innerCheck(const char * xml, std::size_t len)
 		{
 			return;
 		}
-		++s;
-		if (*s == '#')
-		{
-			++s;
-			for (; s != end; ++s)
-			{
-				if (*s == ';')
-				{
-					++s;
-					break;
-				}
-				else if (!(*s >= '0' && *s <= '9'))
-				{
-					throw exception(exception::Type::ParseIncorrectEscapeCharacter);
-				}
-			}
-		}
-		else
+		std::uint32_t c;
+		s = inner::entityRef(s + 1, end, c);
+		if (s == nullptr)
 		{
-			// Letters
-			if (strncmp(s, "lt;", 3) != 0 && strncmp(s, "gt;", 3) != 0 &&
-				strncmp(s, "quot;", 5) != 0 && strncmp(s, "amp;", 4) != 0 &&
-				strncmp(s, "apos;", 5) != 0
-			)
-			{
-				throw exception(exception::Type::ParseIncorrectEscapeCharacter);
-			}
-			s += 3;
+			throw exception(exception::Type::ParseIncorrectEscapeCharacter);
 		}
 	};
+
 	
 	std::size_t emptyCount = 0;
 
@@ -1462,7 +5981,7 @@ inline void xmlite::xml::innerCheck(const char * xml, std::size_t len)
 		}
 		else
 		{
-			++start;
+			start = inner::findAny(start + 1, end, '<', '&');
 		}
 	}
 
@@ -1477,258 +5996,296 @@ inline void xmlite::xml::innerCheck(const char * xml, std::size_t len)
 	}
 }
 
-inline xmlite::xml::version xmlite::xml::getVersion(const char * xmlFile, std::size_t length, bool & init)
+#if defined(XMLITE_FILE_MAPPING)
+inline xmlite::mappedfile::mappedfile(const char * path)
 {
-	length = strlen(xmlFile, length);
-
-	init = false;
-	const char * start = xmlFile, * end = xmlFile + length;
-	for (; start != end; ++start)
+#if defined(_WIN32)
+	// Paths are UTF-8, like everything else
+	const int wideLen = MultiByteToWideChar(CP_UTF8, 0, path, -1, nullptr, 0);
+	std::wstring widePath(std::size_t(wideLen > 0 ? wideLen : 1), L'\0');
+	if (wideLen <= 0 || MultiByteToWideChar(CP_UTF8, 0, path, -1, &widePath[0], wideLen) != wideLen)
 	{
-		if (strncmp(start, "<?xml", 5) == 0)
-		{
-			start += 5;
-			break;
-		}
+		throw exception(exception::Type::FileOpenFailed, path, 0);
 	}
-	if (start == end)
+
+	HANDLE file = CreateFileW(widePath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
 	{
-		return {};
+		throw exception(exception::Type::FileOpenFailed, path, 0);
 	}
-
-	for (; start != end; --end)
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size) || std::uint64_t(size.QuadPart) > std::uint64_t(SIZE_MAX))
 	{
-		if (strncmp(end - 1, "?>", 2) == 0)
-		{
-			break;
-		}
+		CloseHandle(file);
+		throw exception(exception::Type::FileOpenFailed, path, 0);
 	}
-	if (start == end)
+	if (size.QuadPart == 0)
 	{
-		return {};
+		// Empty files can't be mapped
+		CloseHandle(file);
+		return;
 	}
 
-	for (; start != end; ++start)
+	this->m_mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	CloseHandle(file);
+	const void * view = this->m_mapping != nullptr ? MapViewOfFile(this->m_mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+	if (view == nullptr)
 	{
-		if (strncmp(start, " version", 8) == 0)
-		{
-			start += 8;
-			break;
-		}
+		this->release();
+		throw exception(exception::Type::FileOpenFailed, path, 0);
 	}
-	if (start == end)
+	this->m_data = static_cast<const char *>(view);
+	this->m_size = std::size_t(size.QuadPart);
+#else
+	int fd;
+	do
 	{
-		return {};
+		fd = ::open(path, O_RDONLY | O_CLOEXEC);
+	} while (fd == -1 && errno == EINTR);
+	if (fd == -1)
+	{
+		throw exception(exception::Type::FileOpenFailed, path, 0);
 	}
-
-	for (; start != end; ++start)
+	struct stat info;
+	if (::fstat(fd, &info) != 0 || !S_ISREG(info.st_mode))
 	{
-		if (*start == '=')
-		{
-			++start;
-			break;
-		}
+		::close(fd);
+		throw exception(exception::Type::FileOpenFailed, path, 0);
 	}
-	if (start == end)
+	if (info.st_size == 0)
 	{
-		return {};
+		// Empty files can't be mapped
+		::close(fd);
+		return;
 	}
 
-	for (; start != end; ++start)
+	const std::size_t size = std::size_t(info.st_size);
+	void * mem = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (mem == MAP_FAILED)
 	{
-		if (*start >= '0' && *start <= '9')
-		{
-			// Check for all possible versions
-			using tempt = typename std::underlying_type<version>::type;
-			for (tempt i = 0, sz = underlying_cast(version::enum_size); i < sz; ++i)
-			{
-				if (strncmp(start, versionStr[i], std::strlen(versionStr[i])) == 0)
-				{
-					init = true;
-					return static_cast<version>(i);
-				}
-			}
-		}
+		throw exception(exception::Type::FileOpenFailed, path, 0);
 	}
-
-	return {};
+	// Only a hint, read-ahead works the same without it
+	::posix_madvise(mem, size, POSIX_MADV_SEQUENTIAL);
+	this->m_data = static_cast<const char *>(mem);
+	this->m_size = size;
+#endif
 }
-inline std::string xmlite::xml::getEncoding(const char * xmlFile, std::size_t length, bool & init)
+inline void xmlite::mappedfile::release() noexcept
 {
-	length = strlen(xmlFile, length);
-
-	init = false;
-	
-	auto bom = getBOM(xmlFile, length);
-	// Check for BOM first
-	if (bom != -1)
+#if defined(_WIN32)
+	if (this->m_size != 0)
 	{
-		init = true;
-		return BOMStrings[bom];
+		UnmapViewOfFile(this->m_data);
 	}
-
-	const char * start = xmlFile, * end = xmlFile + length;
-
-	for (; start != end; ++start)
+	if (this->m_mapping != nullptr)
 	{
-		if (strncmp(start, "<?xml", 5) == 0)
-		{
-			start += 5;
-			break;
-		}
+		CloseHandle(this->m_mapping);
+		this->m_mapping = nullptr;
 	}
-	if (start == end)
+#else
+	if (this->m_size != 0)
 	{
-		return { defEnc };
+		::munmap(const_cast<char *>(this->m_data), this->m_size);
 	}
+#endif
+	this->m_data = "";
+	this->m_size = 0;
+}
 
-	for (; start != end; --end)
-	{
-		if (strncmp(end - 1, "?>", 2) == 0)
-		{
-			break;
-		}
-	}
-	if (start == end)
+inline xmlite::xml xmlite::xml::fromFile(const char * path, const parseOptions & options)
+{
+	auto file = std::make_shared<const mappedfile>(path);
+	if (options.engine == parseEngine::Recursive && options.storage == docStorage::Nodes)
 	{
-		return { defEnc };
+		// The recursive engine relies on a terminating null
+		return xml(std::string(file->data(), file->size()), options);
 	}
-
-	for (; start != end; ++start)
+	xml doc(file->data(), file->size(), options);
+	if (options.storage == docStorage::View && doc.m_doc.m_source == nullptr)
 	{
-		if (strncmp(start, " encoding", 9) == 0)
-		{
-			start += 9;
-			break;
-		}
+		// The views point into the mapping
+		doc.m_doc.m_source = std::move(file);
 	}
-	if (start == end)
+	return doc;
+}
+#else
+inline xmlite::xml xmlite::xml::fromFile(const char * path, const parseOptions & options)
+{
+	std::FILE * file = std::fopen(path, "rb");
+	if (file == nullptr)
 	{
-		return { defEnc };
+		throw exception(exception::Type::FileOpenFailed, path, 0);
 	}
 
-	for (; start != end; ++start)
+	auto contents = std::make_shared<std::string>(std::size_t(64 * 1024), '\0');
+	std::size_t length = 0;
+	while (true)
 	{
-		if (*start == '=')
+		length += std::fread(&(*contents)[length], 1, contents->size() - length, file);
+		if (length < contents->size())
 		{
-			++start;
 			break;
 		}
+		contents->resize(contents->size() * 2);
 	}
-	if (start == end)
+	const bool failed = std::ferror(file) != 0;
+	std::fclose(file);
+	if (failed)
 	{
-		return { defEnc };
+		throw exception(exception::Type::FileOpenFailed, path, 0);
 	}
+	contents->resize(length);
 
-	for (; start != end; ++start)
+	xml doc(contents->c_str(), contents->length(), options);
+	if (options.storage == docStorage::View && doc.m_doc.m_source == nullptr)
 	{
-		if (*start == '"')
-		{
-			++start;
-			break;
-		}
+		// The views point into the contents
+		doc.m_doc.m_source = std::move(contents);
 	}
-	if (start == end)
+	return doc;
+}
+#endif
+
+inline void xmlite::xml::checkUTF8(const char * xmlFile, const char * start, std::size_t length)
+{
+	if (length == 0)
 	{
-		return { defEnc };
+		return;
 	}
-
-	for (const char * end2 = start + 1; start != end; ++end2)
+	const std::size_t bad = xmlite::validateUTF8(start, length);
+	if (bad != length)
 	{
-		if (*end2 == '"')
-		{
-			init = true;
-			return { start, static_cast<std::size_t>(end2 - start) };
-		}
+		throw exception(exception::Type::ParseInvalidUTF8, std::size_t(start - xmlFile) + bad);
 	}
-
-	return { defEnc };
 }
-inline bool xmlite::xml::getStandalone(const char * xmlFile, std::size_t length, bool & init)
+
+inline xmlite::xml::prolog xmlite::xml::parseProlog(const char * xmlFile, std::size_t length)
 {
 	length = strlen(xmlFile, length);
-	
-	init = false;
-	const char * start = xmlFile, * end = xmlFile + length;
-	for (; start != end; ++start)
+
+	prolog decl;
+	const char * it = xmlFile, * end = xmlFile + length;
+
+	auto startsWith = [](const char * it, const char * end, const char * str, std::size_t len)
 	{
-		if (strncmp(start, "<?xml", 5) == 0)
-		{
-			start += 5;
-			break;
-		}
-	}
-	if (start == end)
+		return std::size_t(end - it) >= len && std::memcmp(it, str, len) == 0;
+	};
+	auto skipWhiteSpace = [](const char * it, const char * end)
 	{
-		return {};
-	}
+		for (; it != end && inner::isWhiteSpace(*it); ++it);
+		return it;
+	};
 
-	for (; start != end; --end)
+	if (getBOM(xmlFile, length) == underlying_cast(BOMencoding::UTF_8))
 	{
-		if (strncmp(end - 1, "?>", 2) == 0)
-		{
-			break;
-		}
+		it += BOMLength[underlying_cast(BOMencoding::UTF_8)];
 	}
-	if (start == end)
+
+	// The declaration may only be preceded by whitespace, nothing after it is looked at
+	it = skipWhiteSpace(it, end);
+	if (!startsWith(it, end, "<?xml", 5))
 	{
-		return {};
+		return decl;
 	}
+	it += 5;
 
-	for (; start != end; ++start)
+	while (true)
 	{
-		if (strncmp(start, " standalone", 11) == 0)
+		const char * nameStart = skipWhiteSpace(it, end);
+		if (nameStart == it || nameStart == end || *nameStart == '?' || *nameStart == '>')
 		{
-			start += 11;
 			break;
 		}
-	}
-	if (start == end)
-	{
-		return {};
-	}
 
-	for (; start != end; ++start)
-	{
-		if (*start == '=')
+		for (it = nameStart; it != end && *it != '=' && *it != '?' && *it != '>' && !inner::isWhiteSpace(*it); ++it);
+		const std::size_t nameLen = std::size_t(it - nameStart);
+
+		it = skipWhiteSpace(it, end);
+		if (it == end || *it != '=')
+		{
+			break;
+		}
+		it = skipWhiteSpace(it + 1, end);
+		if (it == end || (*it != '"' && *it != '\''))
 		{
-			++start;
 			break;
 		}
-	}
-	if (start == end)
-	{
-		return {};
-	}
 
-	for (; start != end; ++start)
-	{
-		if (*start == '"')
+		const char quote = *it;
+		const char * valueStart = ++it;
+		for (; it != end && *it != quote && *it != '>'; ++it);
+		if (it == end || *it != quote)
 		{
-			++start;
 			break;
 		}
-	}
-	if (start == end)
-	{
-		return {};
-	}
+		const std::size_t valueLen = std::size_t(it - valueStart);
+		++it;
 
-	for (; start != end; ++start)
-	{
-		if (strncmp(start, "yes\"", 4) == 0)
+		if (nameLen == 7 && std::memcmp(nameStart, "version", 7) == 0)
 		{
-			init = true;
-			return true;
+			using tempt = typename std::underlying_type<version>::type;
+			for (tempt i = 0, sz = underlying_cast(version::enum_size); i < sz; ++i)
+			{
+				if (valueLen == std::strlen(versionStr[i]) && std::memcmp(valueStart, versionStr[i], valueLen) == 0)
+				{
+					decl.ver     = static_cast<version>(i);
+					decl.verInit = true;
+					break;
+				}
+			}
 		}
-		else if (strncmp(start, "no\"", 3) == 0)
+		else if (nameLen == 8 && std::memcmp(nameStart, "encoding", 8) == 0)
 		{
-			init = true;
-			return false;
+			decl.encoding.assign(valueStart, valueLen);
+			decl.encInit = true;
+		}
+		else if (nameLen == 10 && std::memcmp(nameStart, "standalone", 10) == 0)
+		{
+			if (valueLen == 3 && std::memcmp(valueStart, "yes", 3) == 0)
+			{
+				decl.standalone = true;
+				decl.saInit     = true;
+			}
+			else if (valueLen == 2 && std::memcmp(valueStart, "no", 2) == 0)
+			{
+				decl.standalone = false;
+				decl.saInit     = true;
+			}
 		}
 	}
 
-	return {};
+	return decl;
+}
+inline xmlite::xml::version xmlite::xml::getVersion(const char * xmlFile, std::size_t length, bool & init)
+{
+	auto decl = parseProlog(xmlFile, length);
+	init = decl.verInit;
+	return decl.ver;
+}
+inline std::string xmlite::xml::getEncoding(const char * xmlFile, std::size_t length, bool & init)
+{
+	length = strlen(xmlFile, length);
+
+	auto bom = getBOM(xmlFile, length);
+	// Check for BOM first
+	if (bom != -1)
+	{
+		init = true;
+		return BOMStrings[bom];
+	}
+
+	auto decl = parseProlog(xmlFile, length);
+	init = decl.encInit;
+	return std::move(decl.encoding);
+}
+inline bool xmlite::xml::getStandalone(const char * xmlFile, std::size_t length, bool & init)
+{
+	auto decl = parseProlog(xmlFile, length);
+	init = decl.saInit;
+	return decl.standalone;
 }
 inline std::int8_t xmlite::xml::getBOM(const char * xmlFile, std::size_t length)
 {
@@ -0,0 +1,312 @@
+#include "../include/xmlite.hpp"
+
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <iostream>
+
+// Decoder throughput benchmark, repeats the UTF-7 and UTF-1 test documents
+// until they are a few megabytes long and reports MB/s of input decoded,
+// both for the library's decoders and for the original scalar loops below.
+//
+// Usage: bench [megabytes] [rounds]
+
+// The byte-at-a-time decoders the table-driven ones replaced, kept as a baseline
+namespace baseline
+{
+	static std::string UTF7toUTF8(const char * utfStr, std::size_t length)
+	{
+		length = xmlite::strlen(utfStr, length);
+
+		std::string utf8;
+		utf8.reserve(length);
+
+		auto fromBase64 = [](char ch)
+		{
+			if (ch >= 'A' && ch <= 'Z')
+			{
+				return ch - 'A';
+			}
+			else if (ch >= 'a' && ch <= 'z')
+			{
+				return ch - 'a' + 26;
+			}
+			else if (ch >= '0' && ch <= '9')
+			{
+				return ch - '0' + 52;
+			}
+			else if (ch == '+')
+			{
+				return 62;
+			}
+			else if (ch == '/')
+			{
+				return 63;
+			}
+			else
+			{
+				return 0;
+			}
+		};
+
+		auto utfBufToStr = [&utf8](const char16_t * utfBuf, std::uint8_t shifts)
+		{
+			std::uint8_t chs = 0;
+			for (std::uint8_t i = 0, m = shifts / 16; i < m; ++i)
+			{
+				bool useAux;
+				if (i < (m - 1))
+				{
+					utf8 += xmlite::UTFCodePointToUTF8(xmlite::UTF16toCodePoint(utfBuf[i], utfBuf[i + 1], useAux));
+					i += useAux;
+					chs += 1 + useAux;
+				}
+				else
+				{
+					auto codePoint = xmlite::UTF16toCodePoint(utfBuf[i], 0, useAux);
+					if (!useAux)
+					{
+						utf8 += xmlite::UTFCodePointToUTF8(codePoint);
+						++chs;
+					}
+					else
+					{
+						break;
+					}
+				}
+			}
+			return chs;
+		};
+
+		for (const char * end = utfStr + length; utfStr != end; ++utfStr)
+		{
+			if (*utfStr == '+')
+			{
+				++utfStr;
+				if (*utfStr == '-')
+				{
+					utf8 += '+';
+				}
+				else
+				{
+					// Decode code point
+					char16_t utfBuf[3] = { 0 };
+					std::uint8_t utfIdx = 0, shifts = 0;
+					for (; utfStr != end && *utfStr != '\0'; ++utfStr)
+					{
+						if (*utfStr == '-')
+						{
+							break;
+						}
+
+						// Add code point
+						shifts += 6;
+						char16_t num = char16_t(fromBase64(*utfStr));
+						std::uint8_t idx = shifts / 16, shifts16 = utfIdx * 16 + 16;
+						if (utfIdx == idx)
+						{
+							utfBuf[utfIdx] |= num << (shifts16 - shifts);
+						}
+						else
+						{
+							utfBuf[utfIdx] |= num >> (shifts - shifts16);
+							++utfIdx;
+							if (shifts != shifts16)
+							{
+								utfBuf[utfIdx] |= num << (shifts16 + 16 - shifts);
+							}
+						}
+						if (shifts != 0 && (shifts % 16) == 0)
+						{
+							std::uint8_t chs = utfBufToStr(utfBuf, shifts);
+
+							if (chs != 0)
+							{
+								shifts -= 16 * chs;
+								std::memmove(utfBuf, &utfBuf[chs], (3 - chs) * sizeof(char16_t));
+								std::memset(&utfBuf[3 - chs], 0, chs * sizeof(char16_t));
+								utfIdx -= chs;
+							}
+						}
+					}
+					utfBufToStr(utfBuf, shifts);
+				}
+			}
+			else
+			{
+				utf8 += *utfStr;
+			}
+		}
+
+		return utf8;
+	}
+	static std::string UTF1toUTF8(const char * utfStr, std::size_t length)
+	{
+		constexpr std::uint32_t range = 190, range2 = range * range, range3 = range2 * range, range4 = range2 * range2;
+
+		length = xmlite::strlen(utfStr, length);
+
+		std::string utf8;
+		utf8.reserve(length);
+
+		auto toUTF1Range = [](std::uint8_t ch) -> std::uint8_t
+		{
+			if (ch > 0x20 && ch < 0x7F)
+			{
+				return ch - 0x21;
+			}
+			else if (ch > 0x9F)
+			{
+				return ch - 0xA0 + 0x5E;
+			}
+			else
+			{
+				return 0;
+			}
+		};
+
+		for (const char * end = utfStr + length; utfStr != end; ++utfStr)
+		{
+			std::uint8_t ch = *utfStr;
+			// UTF-1 length of 1
+			if (ch <= 0x9F)
+			{
+				if (ch > 0x7F)
+				{
+					utf8 += char(0xC2);
+				}
+				utf8 += ch;
+			}
+			// Other lengths
+			else
+			{
+				std::uint32_t codePoint = 0;
+				// Length of 2
+				if (ch <= 0xF5)
+				{
+					if (utfStr + 1 == end)
+					{
+						break;
+					}
+					++utfStr;
+					const std::uint8_t ch2 = *utfStr;
+				
+					if (ch == 0xA0)
+					{
+						utf8 += 0xC2 + (ch2 > 0xBF);
+						utf8 += ch2  - (ch2 > 0xBF) * 0x40;
+						continue;
+					}
+					else
+					{
+						codePoint = std::uint32_t(ch - 0xA1) * range + std::uint32_t(toUTF1Range(ch2)) + 0x0100;
+					}
+				}
+				// Length of 3
+				else if (ch <= 0xFB)
+				{
+					if (utfStr + 2 == end)
+					{
+						break;
+					}
+					++utfStr;
+					const std::uint8_t ch2 = *utfStr;
+					++utfStr;
+					const std::uint8_t ch3 = *utfStr;
+
+					codePoint = std::uint32_t(ch - 0xF6) * range2 + toUTF1Range(ch2) * range + toUTF1Range(ch3) + 0x4016;
+				}
+				// Length of 5
+				else if (ch <= 0xFD)
+				{
+					if (utfStr + 4 == end)
+					{
+						break;
+					}
+					++utfStr;
+					const std::uint8_t ch2 = *utfStr;
+					++utfStr;
+					const std::uint8_t ch3 = *utfStr;
+					++utfStr;
+					const std::uint8_t ch4 = *utfStr;
+					++utfStr;
+					const std::uint8_t ch5 = *utfStr;
+
+					codePoint = std::uint32_t(ch - 0xFC) * range4 + toUTF1Range(ch2) * range3 +
+						toUTF1Range(ch3) * range2 + toUTF1Range(ch4) * range + toUTF1Range(ch5) + 0x038E2E;
+				}
+				utf8 += xmlite::UTFCodePointToUTF8(codePoint);
+			}
+		}
+
+		return utf8;
+	}
+}
+
+static std::string readFile(const char * path)
+{
+	std::ifstream input(path, std::ios::binary);
+	if (!input.good())
+	{
+		return std::string();
+	}
+	std::stringstream iss;
+	iss << input.rdbuf();
+	return iss.str();
+}
+
+static std::string scale(const std::string & sample, std::size_t size)
+{
+	std::string out;
+	out.reserve(size + sample.length());
+	while (out.length() < size)
+	{
+		out += sample;
+	}
+	return out;
+}
+
+template<typename Decoder>
+static void run(const char * name, const std::string & input, int rounds, Decoder decode)
+{
+	std::size_t outSize = 0;
+	double best = 0.0;
+	for (int i = 0; i < rounds; ++i)
+	{
+		auto start = std::chrono::steady_clock::now();
+		std::string out = decode(input.c_str(), input.length());
+		std::chrono::duration<double> took = std::chrono::steady_clock::now() - start;
+		outSize = out.length();
+		if (best == 0.0 || took.count() < best)
+		{
+			best = took.count();
+		}
+	}
+	std::cout << name << ": " << input.length() << " -> " << outSize << " bytes, "
+		<< double(input.length()) / (1024.0 * 1024.0) / best << " MB/s" << std::endl;
+}
+
+int main(int argc, char ** argv)
+{
+	std::size_t megabytes = argc > 1 ? std::size_t(std::stoul(argv[1])) : 16;
+	int rounds = argc > 2 ? std::stoi(argv[2]) : 5;
+
+	std::string utf7 = readFile("testUTF7.xml"), utf1 = readFile("testUTF1.xml");
+	if (utf7.empty() || utf1.empty())
+	{
+		std::cerr << "Run from the test directory!" << std::endl;
+		return 1;
+	}
+
+	// Skip the BOMs, so that the repeated samples are plain encoded text
+	utf7 = scale(utf7.substr(4), megabytes * 1024 * 1024);
+	utf1 = scale(utf1.substr(3), megabytes * 1024 * 1024);
+
+	run("UTF-7 baseline", utf7, rounds, [](const char * str, std::size_t len) { return baseline::UTF7toUTF8(str, len); });
+	run("UTF-7", utf7, rounds, [](const char * str, std::size_t len) { return xmlite::UTF7toUTF8(str, len); });
+	run("UTF-1 baseline", utf1, rounds, [](const char * str, std::size_t len) { return baseline::UTF1toUTF8(str, len); });
+	run("UTF-1", utf1, rounds, [](const char * str, std::size_t len) { return xmlite::UTF1toUTF8(str, len); });
+
+	return 0;
+}
@@ -0,0 +1,270 @@
+#include "../include/xmlite.hpp"
+
+#include <string>
+#include <vector>
+#include <sstream>
+#include <iostream>
+
+// Checks that the incremental, parallel & batch parsers and the writer agree with the one-shot parser,
+// every failed check is printed & the exit code is their count
+
+static int failures = 0;
+
+static void expect(bool cond, const std::string & what)
+{
+	if (!cond)
+	{
+		std::cerr << "FAILED: " << what << std::endl;
+		++failures;
+	}
+}
+
+// Exception message, or an empty string if parsing succeeded
+template<typename Parse>
+static std::string error(Parse parse)
+{
+	try
+	{
+		parse();
+	}
+	catch (const xmlite::exception & e)
+	{
+		return e.what();
+	}
+	return std::string();
+}
+
+// Records every event, text split at chunk boundaries is joined again
+struct recorder : xmlite::saxhandler
+{
+	std::string log;
+	bool inText{ false };
+
+	void startElement(xmlite::strview name, const xmlite::attrview * attrs, std::size_t numAttrs)
+	{
+		this->log += '<' + name.str();
+		for (std::size_t i = 0; i < numAttrs; ++i)
+		{
+			this->log += ' ' + attrs[i].name.str() + "=\"" + attrs[i].value.str() + '"';
+		}
+		this->log += '>';
+		this->inText = false;
+	}
+	void endElement(xmlite::strview name)
+	{
+		this->log += "</" + name.str() + '>';
+		this->inText = false;
+	}
+	void text(xmlite::strview value)
+	{
+		this->log += (this->inText ? "" : "T:") + value.str();
+		this->inText = true;
+	}
+	void comment(xmlite::strview value)
+	{
+		this->log += "C:" + value.str() + '|';
+		this->inText = false;
+	}
+};
+
+static const std::string sample =
+	"<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+	"<!-- leading comment -->\n"
+	"<root a=\"1 &amp; 2\" b='single \"quoted\"'>\n"
+	"\t<item id=\"1\">text &lt;with&gt; references &#x41;&#66;</item>\n"
+	"\t<item id=\"2\"><![CDATA[raw <markup> & ]] stuff]]></item>\n"
+	"\t<empty/>\n"
+	"\t<nested><deeper attr=\"v&gt;w\">caf\xC3\xA9 \xE2\x82\xAC \xF0\x9F\x98\x80</deeper></nested>\n"
+	"\t<!-- inner comment - with a dash -->\n"
+	"\t<?target instruction?>\n"
+	"\t<spaced  x = \"y\" ></spaced >\n"
+	"</root>\n"
+	"<!-- trailing comment -->\n";
+
+// Feeding a document in pieces of any size gives the same events & tree as parsing it at once
+static void chunkSplits()
+{
+	for (int decode = 0; decode < 2; ++decode)
+	{
+		xmlite::parseOptions options;
+		options.decodeEntities = decode != 0;
+		options.validateUTF8 = true;
+
+		recorder whole;
+		xmlite::parse(sample, whole, options);
+		const std::string tree = xmlite::xmlnode(sample, options).dump();
+
+		for (std::size_t size = 1; size <= sample.length(); size = size < 24 ? size + 1 : size * 2)
+		{
+			const std::string what = " in " + std::to_string(size) + "-byte chunks" + (decode ? ", decoded" : "");
+
+			recorder pieces;
+			xmlite::pushparser<recorder> push(pieces, options);
+			xmlite::nodeparser nodes(options);
+			for (std::size_t i = 0; i < sample.length(); i += size)
+			{
+				const std::size_t len = size < sample.length() - i ? size : sample.length() - i;
+				push.feed(sample.data() + i, len);
+				nodes.feed(sample.data() + i, len);
+			}
+			push.finish();
+			expect(pieces.log == whole.log, "pushparser events" + what);
+			expect(nodes.finish().dump() == tree, "nodeparser tree" + what);
+		}
+	}
+
+	// Errors are the same whichever chunk they are found in
+	const std::string bad = sample.substr(0, sample.find("</nested>")) + "</wrong>" + sample.substr(sample.find("</nested>") + 9);
+	const std::string expected = error([&bad]() { xmlite::check(bad); });
+	expect(!expected.empty(), "mismatched end tag is an error");
+	for (std::size_t size : { 1, 7, 64 })
+	{
+		const std::string got = error([&bad, size]()
+		{
+			xmlite::nodeparser nodes;
+			for (std::size_t i = 0; i < bad.length(); i += size)
+			{
+				nodes.feed(bad.data() + i, size < bad.length() - i ? size : bad.length() - i);
+			}
+			nodes.finish();
+		});
+		expect(got == expected, "nodeparser error in " + std::to_string(size) + "-byte chunks");
+	}
+}
+
+// Documents above inner::parallelMinSize are split between threads, the result has to match a single thread
+static void parallelVsSerial()
+{
+	std::string big = "<?xml version=\"1.0\"?><!-- head --><root>";
+	for (std::size_t i = 0; big.length() < 2 * xmlite::inner::parallelMinSize; ++i)
+	{
+		const std::string n = std::to_string(i);
+		big += "<record id=\"" + n + "\" note='a &amp; b'><name>n" + n + " &lt;x&gt;</name><!-- c" + n + " -->";
+		big += i % 7 == 0 ? "<![CDATA[<raw> & ]]>" : "<v/>";
+		big += "</record>\n";
+	}
+	big += "</root><!-- tail -->";
+
+	for (int decode = 0; decode < 2; ++decode)
+	{
+		xmlite::parseOptions serial;
+		serial.decodeEntities = decode != 0;
+		const std::string tree = xmlite::xmlnode(big, serial).dump();
+
+		for (std::size_t threads : { 0, 2, 3 })
+		{
+			const std::string what = " with " + std::to_string(threads) + " threads" + (decode ? ", decoded" : "");
+			xmlite::parseOptions parallel = serial;
+			parallel.threads = threads;
+			expect(xmlite::xmlnode(big, parallel).dump() == tree, "parallel tree" + what);
+			expect(error([&big, &parallel]() { xmlite::check(big, parallel); }).empty(), "parallel check" + what);
+		}
+	}
+
+	// An error in a later section is reported like the single pass reports it
+	std::string bad = big;
+	bad.insert(bad.find("<record", bad.length() * 3 / 4), "</root>");
+	const std::string expected = error([&bad]() { xmlite::check(bad); });
+	expect(!expected.empty(), "end tag of the root in the middle is an error");
+
+	xmlite::parseOptions parallel;
+	parallel.threads = 3;
+	expect(error([&bad, &parallel]() { xmlite::check(bad, parallel); }) == expected, "parallel check error");
+	expect(error([&bad, &parallel]() { xmlite::xmlnode(bad, parallel); }) == error([&bad]() { xmlite::xmlnode(bad, xmlite::parseOptions()); }),
+		"parallel build error");
+}
+
+// Batch results come back in order & match parsing each document on its own
+static void batchMatchesSingle()
+{
+	std::vector<std::string> store;
+	for (int i = 0; i < 200; ++i)
+	{
+		const std::string n = std::to_string(i);
+		store.push_back("<?xml version=\"1.0\"?><msg id=\"" + n + "\">body &amp; " + n + (i % 3 == 0 ? "<b>x</b>" : "") + "</msg>");
+	}
+	store[17] = "<?xml version=\"1.0\"?><msg>unclosed";
+	store[42] = "<?xml version=\"1.0\"?><msg></other>";
+	store[99] = std::string();
+
+	const std::vector<xmlite::strview> docs(store.begin(), store.end());
+	xmlite::batchparser pool(3);
+	for (int round = 0; round < 2; ++round)
+	{
+		const auto results = pool.parse(docs);
+		expect(results.size() == docs.size(), "one batch result per document");
+		for (std::size_t i = 0; i < results.size() && i < docs.size(); ++i)
+		{
+			std::string got, single;
+			if (results[i].error)
+			{
+				got = error([&results, i]() { std::rethrow_exception(results[i].error); });
+			}
+			else
+			{
+				got = results[i].node.dump();
+			}
+			try
+			{
+				single = xmlite::xmlnode(store[i]).dump();
+			}
+			catch (const xmlite::exception & e)
+			{
+				single = e.what();
+			}
+			expect(got == single, "batch document " + std::to_string(i));
+		}
+	}
+}
+
+// The writer escapes what it has to, closes empty elements & its output reads back to the values written
+static void writerOutput()
+{
+	std::ostringstream os;
+	{
+		xmlite::writer w(os, xmlite::dumpStyle::Minified, 16);
+		w.declaration().start("root").attr("quote", "say \"a<b & c\"").attr("num", 1.5);
+		w.start("item").text("x < y & z").end();
+		w.comment("note");
+		w.start("empty").end("empty");
+		w.start("count").text(42).end();
+		w.end("root");
+	}
+	const std::string out = os.str();
+	expect(out == "<?xml version=\"1.0\" encoding=\"UTF-8\"?><root quote=\"say &quot;a&lt;b &amp; c&quot;\" num=\"1.5\">"
+		"<item>x &lt; y &amp; z</item><!--note--><empty/><count>42</count></root>", "writer output: " + out);
+
+	xmlite::parseOptions decoded;
+	decoded.decodeEntities = true;
+	xmlite::xmlnode root;
+	const std::string err = error([&root, &out, &decoded]() { root = xmlite::xmlnode(out, decoded); });
+	expect(err.empty(), "writer output parses: " + err);
+	if (!err.empty())
+	{
+		return;
+	}
+	const auto & r = root;
+	expect(r.tag() == "root" && r.attr().at("quote") == "say \"a<b & c\"" && r.attr().at("num") == "1.5", "writer attributes");
+	expect(r.exists("item") && r[r.at("item")[0]][0].text() == "x < y & z", "writer text");
+	expect(r.exists("empty") && r[r.at("empty")[0]].numValues() == 0, "writer empty element");
+	expect(r.exists("count") && r[r.at("count")[0]][0].text() == "42", "writer number");
+
+	std::ostringstream sink;
+	expect(!error([&sink]() { xmlite::writer w(sink); w.start("a").end("b"); }).empty(), "writer rejects a mismatched end");
+	expect(!error([&sink]() { xmlite::writer w(sink); w.start("a").end().start("b"); }).empty(), "writer rejects a second root");
+	expect(!error([&sink]() { xmlite::writer w(sink); w.start("a").text("t").attr("x", "y"); }).empty(), "writer rejects a late attribute");
+}
+
+int main()
+{
+	chunkSplits();
+	parallelVsSerial();
+	batchMatchesSingle();
+	writerOutput();
+
+	if (failures == 0)
+	{
+		std::cout << "All checks passed" << std::endl;
+	}
+	return failures;
+}
@@ -0,0 +1,194 @@
+#include "../include/xmlite.hpp"
+
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <iostream>
+
+// Checks for bugs that were fixed, every failed check is printed & the exit code is their count
+
+static int failures = 0;
+
+static void expect(bool cond, const char * what)
+{
+	if (!cond)
+	{
+		std::cerr << "FAILED: " << what << std::endl;
+		++failures;
+	}
+}
+
+static const std::string header = "<?xml version=\"1.0\"?>";
+
+// A copied view-mode document must not point into the original's arena
+static void viewDocCopy()
+{
+	const std::string src = header + "<r a=\"x&amp;y\" b=\"plain\">t&lt;u</r>";
+	xmlite::parseOptions options;
+	options.storage = xmlite::docStorage::View;
+	options.decodeEntities = true;
+
+	std::unique_ptr<xmlite::xmldoc> orig(new xmlite::xmldoc(src, options));
+	xmlite::xmldoc copy(*orig);
+	orig.reset();
+
+	auto root = copy.root();
+	auto a = root.findAttr("a"), b = root.findAttr("b");
+	expect(a != nullptr && a->value == "x&y", "decoded attribute of a copied view document");
+	expect(b != nullptr && b->value == "plain", "plain attribute of a copied view document");
+	expect(root.firstChild().value() == "t<u", "decoded text of a copied view document");
+}
+
+static bool sameTree(const xmlite::xmlnode & lhs, const xmlite::xmlnode & rhs)
+{
+	if (lhs.tag() != rhs.tag() || lhs.isText() != rhs.isText() || lhs.numValues() != rhs.numValues() || lhs.attr() != rhs.attr())
+	{
+		return false;
+	}
+	for (std::size_t i = 0; i < lhs.numValues(); ++i)
+	{
+		if (!sameTree(lhs[i], rhs[i]))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+// Dumps are well-formed & read back the same
+static bool roundTrips(const xmlite::xmlnode & node, const std::string & src)
+{
+	xmlite::parseOptions options;
+	options.decodeEntities = true;
+	xmlite::dumpOptions minified;
+	minified.style = xmlite::dumpStyle::Minified;
+	const std::string dumped = header + node.dump(minified);
+	try
+	{
+		xmlite::check(dumped);
+	}
+	catch (const xmlite::exception &)
+	{
+		return false;
+	}
+	return sameTree(xmlite::xmlnode(dumped, options), xmlite::xmlnode(src, options));
+}
+
+// Parsed values keep the form they were written in, whatever is next to them or however they're read
+static void escapedValues()
+{
+	const std::string alone = header + "<r c=\"&amp;lt;\"/>", quoted = header + "<r b='q\"z' c=\"&amp;lt;\"/>";
+	xmlite::xmlnode a(alone), b(quoted);
+	expect(a.attr().at("c") == "&amp;lt;" && b.attr().at("c") == "&amp;lt;", "attribute form doesn't depend on its siblings");
+	expect(b.attr().at("b") == "q\"z", "single-quoted attribute is kept as written");
+	expect(roundTrips(a, alone) && roundTrips(b, quoted), "attributes with quotes & references round-trip");
+
+	const std::string text = header + "<r>&amp;lt;</r>";
+	xmlite::xmlnode t(text);
+	const auto & ct = t;
+	const std::string before = ct[0].tag();
+	t[0].tag();
+	expect(before == "&amp;lt;" && ct[0].tag() == before, "writable access leaves the value as it is");
+
+	const std::string cdata = header + "<r><![CDATA[x<y & z]]></r>";
+	xmlite::xmlnode c(cdata);
+	expect(roundTrips(c, cdata), "CDATA with markup characters round-trips");
+
+	c.attr()["x"] = "a&b<\"";
+	std::string dumped = header + c.dump();
+	bool valid = true;
+	try
+	{
+		xmlite::check(dumped);
+	}
+	catch (const xmlite::exception &)
+	{
+		valid = false;
+	}
+	expect(valid, "attribute written to a parsed node is escaped");
+}
+
+// Every UTF-1 lead byte takes the length given by the spec, a truncated sequence at the end is dropped
+static void utf1Sequences()
+{
+	auto utf1 = [](const char * str) { return xmlite::UTF1toUTF8(str, std::strlen(str)); };
+	const std::string fffd = "\xEF\xBF\xBD";
+
+	expect(utf1("a\xA0\xE9\xA1\x21\xCB\xC2") == "a\xC3\xA9\xC4\x80\xE2\x82\xAC", "2-byte sequences");
+	expect(utf1("\xF9\x35\x27\xFC\x21\x39\x6E\x6C") == "\xF0\x9F\x98\x80\xF4\x8F\xBF\xBF", "3 & 5-byte sequences");
+	expect(utf1("\xFC\x21\x39\x6E\x6Dz") == fffd + "z", "value past U+10FFFF");
+	expect(utf1("\xF7\x2F\xC4z") == fffd + "z", "surrogate value");
+	expect(utf1("\xFE\x21\x21\x21\x21z") == fffd + "z", "FE leads a 5-byte sequence");
+	expect(utf1("\xFF\xFF\xFF\xFF\xFFz") == fffd + "z", "FF leads a 5-byte sequence");
+
+	expect(utf1("a\xA1") == "a", "truncated 2-byte sequence");
+	expect(utf1("a\xF6\x21") == "a", "truncated 3-byte sequence");
+	expect(utf1("a\xFC\x21\x21\x21") == "a", "truncated 5-byte sequence");
+	expect(utf1("a\xFE\x21") == "a", "truncated sequence led by FE");
+	expect(utf1("a\xFF") == "a", "truncated sequence led by FF");
+}
+
+// Const lookups by name build the child index on first use, several threads may do that at once
+static void concurrentLookups()
+{
+	std::string src = header + "<r>";
+	for (int i = 0; i < 64; ++i)
+	{
+		src += "<c" + std::to_string(i % 16) + ">";
+		for (int j = 0; j < 16; ++j)
+		{
+			src += "<g" + std::to_string(j) + "/>";
+		}
+		src += "</c" + std::to_string(i % 16) + ">";
+	}
+	src += "</r>";
+	const xmlite::xmlnode r(src);
+
+	std::atomic<int> wrong{ 0 };
+	auto lookup = [&r, &wrong]()
+	{
+		for (int i = 0; i < 16; ++i)
+		{
+			const std::string name = "c" + std::to_string(i);
+			if (!r.exists(name) || r.at(name).size() != 4)
+			{
+				++wrong;
+				continue;
+			}
+			for (std::size_t idx : r.at(name))
+			{
+				if (r[idx].exists("x") || r[idx].at("g" + std::to_string(i)).size() != 1)
+				{
+					++wrong;
+				}
+			}
+		}
+	};
+	std::vector<std::thread> threads;
+	for (int i = 0; i < 4; ++i)
+	{
+		threads.emplace_back(lookup);
+	}
+	for (auto & t : threads)
+	{
+		t.join();
+	}
+	expect(wrong == 0, "const lookups by name from several threads");
+}
+
+int main()
+{
+	viewDocCopy();
+	escapedValues();
+	utf1Sequences();
+	concurrentLookups();
+
+	if (failures == 0)
+	{
+		std::cout << "All checks passed" << std::endl;
+	}
+	return failures;
+}
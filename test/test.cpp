@@ -42,7 +42,7 @@ int main(int argc, char ** argv)
 		out << dom;
 	}
 
-	xmlite::xml xmlObject(str);
+	auto xmlObject = xmlite::xml::fromFile(argv[1]);
 
 	std::cout << "Version: " << xmlObject.getVersion() << '\n';
 	std::cout << "Encoding: " << xmlObject.getEncoding() << '\n';
@@ -50,6 +50,7 @@ int main(int argc, char ** argv)
 
 	std::cout << "Reconstructed header: \"" << xmlObject.dumpHeader() << "\"\n";
 
+	std::string valueBuf;
 	const auto & persons = xmlObject.get().at("person");
 	for (auto i : persons)
 	{
@@ -78,8 +79,8 @@ int main(int argc, char ** argv)
 		const auto & nStr = name[0].tag();
 		const auto & aStr = age[0].tag();
 
-		std::cout << "Name: " << xmlite::escapeChars(nStr.c_str(), nStr.length()) << "; ";
-		std::cout << "Age: " << xmlite::escapeChars(aStr.c_str(), aStr.length()) << '\n';
+		std::cout << "Name: " << xmlite::decodeEntities(nStr, valueBuf) << "; ";
+		std::cout << "Age: " << xmlite::decodeEntities(aStr, valueBuf) << '\n';
 	}
 
 	std::cout << "Reconstructed file:\n" << xmlObject.dump() << std::endl;